@@ -9,16 +9,17 @@
 
 extern SimParameters simParams;
 
-Ball::Ball() : _bbox(BBox(Vec3(), 0, 0, 0)), _m(1), objType("Object") {
+Ball::Ball()
+    : objType("Object"), _bbox(BBox(Vec3(), 0, 0, 0)), _m(1),
+      _elasticity(1) {
   _bbox.setProperties(BBoxProperties::IsSpherical);
 }
 
 Ball::Ball(BBox bounds, double mass, const Vec3 &position, const Vec3 &velocity,
            const double &elasticity, const Vec3 &aVel)
-    : _bbox(bounds), _rot({0, 0, 1, 0}), _m(mass), _vel(velocity), _aVel(aVel),
-      _k(simParams.tuning_objSpringCoeff),
-      _b(simParams.tuning_objSpringDamping), _fNet(Vec3()), _tNet(Vec3()),
-      objType("bouncing ball"), _selected(false) {
+    : objType("bouncing ball"), _bbox(bounds), _rot({0, 0, 1, 0}),
+      _vel(velocity), _aVel(aVel), _fNet(Vec3()), _tNet(Vec3()), _m(mass),
+      _elasticity(elasticity), _selected(false) {
   _bbox.setProperties(BBoxProperties::IsSpherical);
   std::cerr << "obj \"" << objType << "\" create pos " << _bbox.pos() << " vel "
             << _vel << " radius " << _bbox.w() * 0.5 << "\n";
@@ -44,20 +45,9 @@ bool Ball::collidesWith(double dt, const Ball &otherObj) const {
 
 // use sumRadii and positionDiff from collidesWith?
 void Ball::resolveCollision(Ball &otherObj, double dt) {
-  double sumRadii = (_bbox.w() * 0.5) + (otherObj._bbox.w() * 0.5);
-  Vec3 positionDiff = otherObj._bbox.pos() - _bbox.pos();
-  Vec3 velocityDiff = _vel - otherObj.vel();
-  Vec3 reactiveForce =
-      -((_k * (sumRadii - positionDiff.mag()) * positionDiff.unit()) -
-        (_b * velocityDiff.unit()));
-  Vec3 torqueArm = positionDiff.unit() * (_bbox.w() * 0.5);
-  Vec3 velContactPoint = _vel + _aVel.cross(torqueArm);
-  Vec3 frictionForce = -velContactPoint * simParams.tuning_objFrictionCoeff *
-                       reactiveForce.mag();
-  Vec3 frictionTorque =
-      -_aVel * simParams.tuning_objFrictionCoeff * reactiveForce.mag();
-  _fNet += reactiveForce + frictionForce;
-  _tNet += torqueArm.cross(frictionForce) + frictionTorque;
+  addContactForce(_bbox.pos(), _vel, _aVel, _bbox.w() * 0.5,
+                  otherObj._bbox.pos(), otherObj._vel, otherObj._bbox.w() * 0.5,
+                  _fNet, _tNet);
 }
 
 Vec3 Ball::nextPos(double dt) const {
@@ -71,40 +61,96 @@ BBox Ball::nextBBox(double dt) const {
 }
 
 void Ball::move(double dt, Vec3 outsideEnv) {
-  // collision with walls
-  if (outsideEnv.mag() > 0.01) {
-    Vec3 reactiveForce =
-        -((_m * simParams.environment_gravity.mag() *
-           simParams.environment_unitsPerMeter * outsideEnv.unit()) +
-          (_k * outsideEnv) + (_b * _vel));
-    Vec3 torqueArm = outsideEnv.unit() * _bbox.w() * 0.5;
-    Vec3 velContactPoint = _vel + _aVel.cross(torqueArm);
-    Vec3 frictionForce = -velContactPoint * simParams.tuning_objFrictionCoeff *
-                         reactiveForce.mag();
-    // prevent ball from spinning indefinitely at rest on ground
-    Vec3 frictionTorque =
-        -_aVel * simParams.tuning_objFrictionCoeff * 0.01 * reactiveForce.mag();
-    _fNet += reactiveForce + frictionForce;
-    _tNet += torqueArm.cross(frictionForce) + frictionTorque;
-  }
-
-  _fNet +=
-      _m * simParams.environment_gravity * simParams.environment_unitsPerMeter;
-  _accel = (_fNet / _m);
-  _vel = rk4(_vel, _accel, Vec3(), dt);
-  _bbox.setPos(nextPos(dt));
-
+  addWallForce(outsideEnv, _vel, _aVel, _bbox.w() * 0.5, _m, _fNet, _tNet);
+  Vec3 pos = _bbox.pos();
+  integrateBall(dt, _m, _bbox.w() * 0.5,
+                _fNet + _m * simParams.environment_gravity *
+                            simParams.environment_unitsPerMeter,
+                _tNet, pos, _vel, _accel, _aVel, _rot);
+  _bbox.setPos(pos);
   _aAccel = _tNet / (0.4 * _m * pow(_bbox.w() * 0.5, 2));
-  _aVel = rk4(_aVel, _aAccel, Vec3(), dt);
-  Quaternion aVelQuat(_aVel.mag() > 0 ? _aVel.unit() : Vec3(0, 1, 0),
-                      _aVel.mag() * dt);
-  _rot = _rot * aVelQuat;
 
   // zero out net force and torque
   _fNet = Vec3();
   _tNet = Vec3();
 }
 
+template <typename T>
+void addContactForce(const Vec3T<T> &p, const Vec3T<T> &v, const Vec3T<T> &w,
+                     T r, const Vec3T<T> &pOther, const Vec3T<T> &vOther,
+                     T rOther, Vec3T<T> &force, Vec3T<T> &torque) {
+  T springCoeff = simParams.tuning_objSpringCoeff;
+  T springDamping = simParams.tuning_objSpringDamping;
+  T frictionCoeff = simParams.tuning_objFrictionCoeff;
+  T sumRadii = r + rOther;
+  Vec3T<T> positionDiff = pOther - p;
+  Vec3T<T> velocityDiff = v - vOther;
+  Vec3T<T> reactiveForce =
+      -((springCoeff * (sumRadii - positionDiff.mag()) *
+         positionDiff.unit()) -
+        (springDamping * velocityDiff.unit()));
+  Vec3T<T> torqueArm = positionDiff.unit() * r;
+  Vec3T<T> velContactPoint = v + w.cross(torqueArm);
+  Vec3T<T> frictionForce =
+      -velContactPoint * frictionCoeff * reactiveForce.mag();
+  Vec3T<T> frictionTorque = -w * frictionCoeff * reactiveForce.mag();
+  force += reactiveForce + frictionForce;
+  torque += torqueArm.cross(frictionForce) + frictionTorque;
+}
+
+template <typename T>
+void addWallForce(const Vec3T<T> &outsideEnv, const Vec3T<T> &v,
+                  const Vec3T<T> &w, T r, T m, Vec3T<T> &force,
+                  Vec3T<T> &torque) {
+  if (outsideEnv.mag() > T(0.01)) {
+    T gravity = simParams.environment_gravity.mag();
+    T upm = simParams.environment_unitsPerMeter;
+    T springCoeff = simParams.tuning_objSpringCoeff;
+    T springDamping = simParams.tuning_objSpringDamping;
+    T frictionCoeff = simParams.tuning_objFrictionCoeff;
+    Vec3T<T> reactiveForce =
+        -((m * gravity * upm * outsideEnv.unit()) +
+          (springCoeff * outsideEnv) + (springDamping * v));
+    Vec3T<T> torqueArm = outsideEnv.unit() * r;
+    Vec3T<T> velContactPoint = v + w.cross(torqueArm);
+    Vec3T<T> frictionForce =
+        -velContactPoint * frictionCoeff * reactiveForce.mag();
+    // prevent ball from spinning indefinitely at rest on ground
+    Vec3T<T> frictionTorque =
+        -w * frictionCoeff * T(0.01) * reactiveForce.mag();
+    force += reactiveForce + frictionForce;
+    torque += torqueArm.cross(frictionForce) + frictionTorque;
+  }
+}
+
+template <typename T>
+void integrateBall(T dt, T m, T r, const Vec3T<T> &force,
+                   const Vec3T<T> &torque, Vec3T<T> &pos, Vec3T<T> &vel,
+                   Vec3T<T> &accel, Vec3T<T> &aVel, QuatT<T> &rot) {
+  accel = (force / m);
+  vel = rk4(vel, accel, Vec3T<T>(), dt);
+  pos = rk4(pos, vel, accel, dt);
+
+  Vec3T<T> aAccel = torque / (T(0.4) * m * (r * r));
+  aVel = rk4(aVel, aAccel, Vec3T<T>(), dt);
+  QuatT<T> aVelQuat(aVel.mag() > 0 ? aVel.unit() : Vec3T<T>(0, 1, 0),
+                    aVel.mag() * dt);
+  rot = rot * aVelQuat;
+}
+
+#define INSTANTIATE_BALL_PHYSICS(T)                                            \
+  template void addContactForce<T>(                                            \
+      const Vec3T<T> &, const Vec3T<T> &, const Vec3T<T> &, T,                 \
+      const Vec3T<T> &, const Vec3T<T> &, T, Vec3T<T> &, Vec3T<T> &);         \
+  template void addWallForce<T>(const Vec3T<T> &, const Vec3T<T> &,            \
+                                const Vec3T<T> &, T, T, Vec3T<T> &,            \
+                                Vec3T<T> &);                                   \
+  template void integrateBall<T>(T, T, T, const Vec3T<T> &, const Vec3T<T> &,  \
+                                 Vec3T<T> &, Vec3T<T> &, Vec3T<T> &,           \
+                                 Vec3T<T> &, QuatT<T> &);
+INSTANTIATE_BALL_PHYSICS(float)
+INSTANTIATE_BALL_PHYSICS(double)
+
 void Ball::print(std::ostream &out) const {
   out << "type " << objType << " dim " << _bbox.h() << "x" << _bbox.w()
       << " pos " << _bbox.pos() << " vel " << _vel << " accel " << _accel
@@ -28,6 +28,7 @@ public:
   const Vec3 &accel() const { return _accel; };
   const Vec3 &aVel() const { return _aVel; };
   double mass() const { return _m; };
+  double elasticity() const { return _elasticity; };
   bool selected() const { return _selected; };
   std::string type() const { return objType; };
   double kenergy() const;
@@ -50,7 +51,7 @@ public:
       const Ball &obj) const; // whether bbox collides with other object's
   void resolveCollision(Ball &obj, double dt);
   // outsideEnv: push object back in bounds if it would leave
-  void move(double dt, Vec3 outsideEnv = Vec3());
+  void move(double dt, Vec3 outsideEnv = Vec3()); // adds gravity
 
   // debug
   void print(std::ostream &out) const;
@@ -66,16 +67,38 @@ private:
   Vec3 _fNet;      // net force on object
   Vec3 _tNet;      // net torque on object
 
-  double _m; // object mass
-  double _k; // object stiffness (spring constant)
-  double _b; // object damping ratio
+  double _m;          // object mass
+  double _elasticity; // restitution of impulse contacts (0 to 1)
 
   bool _selected; // selected objects will not move
   Vec3 nextPos(
       double dt) const; // position of object at next time step; used internally
   double nextAngle(double dt) const;
+
+  friend class BallStore;
 };
 
+// per-ball physics, shared by Ball and the array loops in Environment.
+// templates over the precision, instantiated for float and double
+
+// penalty contact of a ball (pos p, velocity v, angular velocity w, radius
+// r) against another ball; adds the force and torque on the first ball
+template <typename T>
+void addContactForce(const Vec3T<T> &p, const Vec3T<T> &v, const Vec3T<T> &w,
+                     T r, const Vec3T<T> &pOther, const Vec3T<T> &vOther,
+                     T rOther, Vec3T<T> &force, Vec3T<T> &torque);
+// reaction of the boundary on a ball that is outsideEnv past a wall
+template <typename T>
+void addWallForce(const Vec3T<T> &outsideEnv, const Vec3T<T> &v,
+                  const Vec3T<T> &w, T r, T m, Vec3T<T> &force,
+                  Vec3T<T> &torque);
+// advance one ball by dt under its net force and torque; force must already
+// include gravity
+template <typename T>
+void integrateBall(T dt, T m, T r, const Vec3T<T> &force,
+                   const Vec3T<T> &torque, Vec3T<T> &pos, Vec3T<T> &vel,
+                   Vec3T<T> &accel, Vec3T<T> &aVel, QuatT<T> &rot);
+
 // print compatibility with cout/cerr
 inline std::ostream &operator<<(std::ostream &out, const Ball &obj) {
   obj.print(out);
@@ -0,0 +1,245 @@
+#include "ballStore.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+template <typename T> static void eraseBySwap(std::vector<T> &v, int i) {
+  v[i] = v.back();
+  v.pop_back();
+}
+
+template <typename T>
+static void permuteArray(std::vector<T> &v, const std::vector<int> &order) {
+  std::vector<T> moved(order.size());
+  for (int k = 0; k < int(order.size()); ++k) {
+    moved[k] = v[order[k]];
+  }
+  v.swap(moved);
+}
+
+static void permuteArray(Vec3Array &v, const std::vector<int> &order) {
+  permuteArray(v.x, order);
+  permuteArray(v.y, order);
+  permuteArray(v.z, order);
+}
+
+template <typename T>
+static void writeArray(std::ostream &out, const std::vector<T> &v) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  out.write(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+}
+
+// reads in chunks, so a corrupt count in a short file fails on the read
+// rather than allocating the whole count up front
+template <typename T>
+static bool readArray(std::istream &in, std::vector<T> &v, int count) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  const int CHUNK = 1 << 16;
+  v.clear();
+  while (int(v.size()) < count) {
+    int begin = v.size();
+    v.resize(begin + std::min(CHUNK, count - begin));
+    if (!in.read(reinterpret_cast<char *>(v.data() + begin),
+                 (v.size() - begin) * sizeof(T))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void writeArray(std::ostream &out, const Vec3Array &v) {
+  writeArray(out, v.x);
+  writeArray(out, v.y);
+  writeArray(out, v.z);
+}
+
+static bool readArray(std::istream &in, Vec3Array &v, int count) {
+  return readArray(in, v.x, count) && readArray(in, v.y, count) &&
+         readArray(in, v.z, count);
+}
+
+BallStore::BallStore() {}
+
+int BallStore::slot(int id) const {
+  auto it = _slots.find(id);
+  return it == _slots.end() ? -1 : it->second;
+}
+
+void BallStore::add(int id, const Ball &obj) {
+  if (contains(id)) {
+    remove(id);
+  }
+  _slots[id] = _ids.size();
+  _ids.push_back(id);
+  pos.push_back(obj._bbox.pos());
+  vel.push_back(obj._vel);
+  accel.push_back(obj._accel);
+  aVel.push_back(obj._aVel);
+  aAccel.push_back(obj._aAccel);
+  force.push_back(obj._fNet);
+  torque.push_back(obj._tNet);
+  radius.push_back(obj._bbox.w() * 0.5);
+  mass.push_back(obj._m);
+  elasticity.push_back(obj._elasticity);
+  rot.push_back(QuaternionR(obj._rot));
+  selected.push_back(obj._selected);
+  sleeping.push_back(false);
+  idleTime.push_back(0);
+  wakeUp.push_back(false);
+  prevPos.push_back(obj._bbox.pos());
+  prevRot.push_back(QuaternionR(obj._rot));
+}
+
+void BallStore::remove(int id) {
+  int i = slot(id);
+  if (i == -1) {
+    return;
+  }
+  _slots[_ids.back()] = i;
+  _slots.erase(id);
+  eraseBySwap(_ids, i);
+  pos.eraseBySwap(i);
+  vel.eraseBySwap(i);
+  accel.eraseBySwap(i);
+  aVel.eraseBySwap(i);
+  aAccel.eraseBySwap(i);
+  force.eraseBySwap(i);
+  torque.eraseBySwap(i);
+  eraseBySwap(radius, i);
+  eraseBySwap(mass, i);
+  eraseBySwap(elasticity, i);
+  eraseBySwap(rot, i);
+  eraseBySwap(selected, i);
+  eraseBySwap(sleeping, i);
+  eraseBySwap(idleTime, i);
+  eraseBySwap(wakeUp, i);
+  prevPos.eraseBySwap(i);
+  eraseBySwap(prevRot, i);
+}
+
+void BallStore::clear() {
+  _ids.clear();
+  _slots.clear();
+  pos.clear();
+  vel.clear();
+  accel.clear();
+  aVel.clear();
+  aAccel.clear();
+  force.clear();
+  torque.clear();
+  radius.clear();
+  mass.clear();
+  elasticity.clear();
+  rot.clear();
+  selected.clear();
+  sleeping.clear();
+  idleTime.clear();
+  wakeUp.clear();
+  prevPos.clear();
+  prevRot.clear();
+}
+
+void BallStore::permute(const std::vector<int> &order) {
+  permuteArray(_ids, order);
+  for (int k = 0; k < size(); ++k) {
+    _slots[_ids[k]] = k;
+  }
+  permuteArray(pos, order);
+  permuteArray(vel, order);
+  permuteArray(accel, order);
+  permuteArray(aVel, order);
+  permuteArray(aAccel, order);
+  permuteArray(force, order);
+  permuteArray(torque, order);
+  permuteArray(radius, order);
+  permuteArray(mass, order);
+  permuteArray(elasticity, order);
+  permuteArray(rot, order);
+  permuteArray(selected, order);
+  permuteArray(sleeping, order);
+  permuteArray(idleTime, order);
+  permuteArray(wakeUp, order);
+  permuteArray(prevPos, order);
+  permuteArray(prevRot, order);
+}
+
+BallRef BallStore::at(int id) {
+  int i = slot(id);
+  if (i == -1) {
+    throw std::out_of_range("no ball with this ID");
+  }
+  return BallRef(*this, i);
+}
+
+void BallStore::write(std::ostream &out) const {
+  writeArray(out, _ids);
+  writeArray(out, pos);
+  writeArray(out, vel);
+  writeArray(out, accel);
+  writeArray(out, aVel);
+  writeArray(out, aAccel);
+  writeArray(out, radius);
+  writeArray(out, mass);
+  writeArray(out, elasticity);
+  writeArray(out, rot); // quaternions as w, x, y, z
+  writeArray(out, selected);
+  writeArray(out, sleeping);
+  writeArray(out, idleTime);
+}
+
+bool BallStore::read(std::istream &in, int count) {
+  clear();
+  if (!(readArray(in, _ids, count) && readArray(in, pos, count) &&
+        readArray(in, vel, count) && readArray(in, accel, count) &&
+        readArray(in, aVel, count) && readArray(in, aAccel, count) &&
+        readArray(in, radius, count) && readArray(in, mass, count) &&
+        readArray(in, elasticity, count) && readArray(in, rot, count) &&
+        readArray(in, selected, count) && readArray(in, sleeping, count) &&
+        readArray(in, idleTime, count))) {
+    clear();
+    return false;
+  }
+  _slots.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    if (!_slots.emplace(_ids[i], i).second) {
+      clear();
+      return false; // duplicate ID
+    }
+  }
+  force.resize(count);
+  torque.resize(count);
+  wakeUp.assign(count, false);
+  prevPos = pos;
+  prevRot = rot;
+  return true;
+}
+
+void BallStore::wakeAll() {
+  for (int i = 0; i < size(); ++i) {
+    wake(i);
+  }
+}
+
+BBox BallStore::bbox(int i) const {
+  BBox result(pos.get(i), 2.0 * radius[i]);
+  result.setProperties(BBoxProperties::IsSpherical);
+  return result;
+}
+
+Ball BallStore::ball(int i) const {
+  Ball result;
+  result.objType = "bouncing ball";
+  result._bbox = bbox(i);
+  result._rot = Quaternion(rot[i]);
+  result._vel = vel.get(i);
+  result._accel = accel.get(i);
+  result._aVel = aVel.get(i);
+  result._aAccel = aAccel.get(i);
+  result._fNet = force.get(i);
+  result._tNet = torque.get(i);
+  result._m = mass[i];
+  result._elasticity = elasticity[i];
+  result._selected = selected[i];
+  return result;
+}
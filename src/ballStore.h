@@ -0,0 +1,124 @@
+/* Structure-of-arrays storage for the balls in an environment. Each field
+    lives in its own contiguous array, indexed by the ball's current slot;
+    ball IDs stay stable while slots move when balls are removed. Fields are
+    stored in Real; BallRef and ball() hand out double copies. */
+
+#ifndef BALL_STORE_H
+#define BALL_STORE_H
+
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "ball.h"
+#include "bbox.h"
+#include "quaternion.h"
+#include "vec3d.h"
+
+class BallRef;
+
+class BallStore {
+public:
+  BallStore();
+
+  // per-ball state, indexed by slot
+  Vec3Array pos;    // center position
+  Vec3Array vel;    // velocity
+  Vec3Array accel;  // acceleration over the last step
+  Vec3Array aVel;   // angular velocity
+  Vec3Array aAccel; // angular acceleration over the last step
+  Vec3Array force;  // net force accumulated this step
+  Vec3Array torque; // net torque accumulated this step
+  std::vector<Real> radius;
+  std::vector<Real> mass;
+  std::vector<Real> elasticity; // restitution of impulse contacts
+  std::vector<QuaternionR> rot;
+  std::vector<unsigned char> selected; // selected balls will not move
+  // sleeping balls are not integrated (see Environment::integrateObjs)
+  std::vector<unsigned char> sleeping;
+  std::vector<Real> idleTime; // seconds spent below the sleep thresholds
+  // set by the contact pass when a moving ball touches a sleeping one;
+  // the ball wakes at the start of its integration
+  std::vector<unsigned char> wakeUp;
+  // state before the most recent step, for render interpolation
+  Vec3Array prevPos;
+  std::vector<QuaternionR> prevRot;
+
+  // ID <-> slot
+  int size() const { return _ids.size(); };
+  bool contains(int id) const { return _slots.count(id) > 0; };
+  int slot(int id) const; // -1 if not stored
+  int id(int slot) const { return _ids[slot]; };
+
+  void add(int id, const Ball &obj);
+  void remove(int id); // the last ball moves into the freed slot
+  void clear();
+  // move the ball in slot order[k] to slot k for every k; IDs go with
+  // their balls
+  void permute(const std::vector<int> &order);
+
+  // handle for by-ID access; throws std::out_of_range for unknown IDs
+  BallRef at(int id);
+  BBox bbox(int slot) const;
+  Ball ball(int slot) const; // copy of one ball's state
+  void wake(int slot) {
+    sleeping[slot] = false;
+    idleTime[slot] = 0;
+  };
+  void wakeAll();
+
+  // raw field arrays in native byte order, for environment snapshots;
+  // read() replaces the contents with count balls and returns false on a
+  // short or malformed stream
+  void write(std::ostream &out) const;
+  bool read(std::istream &in, int count);
+
+private:
+  std::vector<int> _ids;                // slot -> ID
+  std::unordered_map<int, int> _slots; // ID -> slot
+};
+
+// one ball in a BallStore; only valid until the store next adds or
+// removes a ball
+class BallRef {
+public:
+  BallRef(BallStore &store, int slot) : _store(store), _slot(slot) {};
+
+  BBox bbox() const { return _store.bbox(_slot); };
+  Quaternion rot() const { return Quaternion(_store.rot[_slot]); };
+  Vec3 vel() const { return _store.vel.get(_slot); };
+  Vec3 aVel() const { return _store.aVel.get(_slot); };
+  double mass() const { return _store.mass[_slot]; };
+  double elasticity() const { return _store.elasticity[_slot]; };
+  bool selected() const { return _store.selected[_slot]; };
+
+  bool sleeping() const { return _store.sleeping[_slot]; };
+
+  // every edit wakes the ball
+  void setPos(const Vec3 &v) {
+    _store.pos.set(_slot, v);
+    _store.wake(_slot);
+  };
+  void setVel(const Vec3 &v) {
+    _store.vel.set(_slot, v);
+    _store.wake(_slot);
+  };
+  void setSelectState(bool state) {
+    _store.selected[_slot] = state;
+    _store.wake(_slot);
+  };
+  void applyForce(const Vec3 &v) {
+    _store.force.add(_slot, v);
+    _store.wake(_slot);
+  };
+  void applyTorque(const Vec3 &v) {
+    _store.torque.add(_slot, v);
+    _store.wake(_slot);
+  };
+
+private:
+  BallStore &_store;
+  int _slot;
+};
+
+#endif
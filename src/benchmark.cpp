@@ -0,0 +1,447 @@
+/* Microbenchmarks for the simulation hot paths. Not part of the simulator;
+    build with `make bench`. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "boundary.h"
+#include "gravityTree.h"
+#include "morton.h"
+#include "sweepPrune.h"
+#include "uniformGrid.h"
+#include "vec3d.h"
+
+namespace {
+
+std::default_random_engine benchRng(1234);
+
+double msSince(std::chrono::steady_clock::time_point t0) {
+  using namespace std::chrono;
+  return duration<double, std::milli>(steady_clock::now() - t0).count();
+}
+
+void pushVertex(std::vector<float> &data, const Vec3 &p, const Vec3 &n) {
+  data.insert(data.end(), {float(p.x()), float(p.y()), float(p.z()),
+                           float(n.x()), float(n.y()), float(n.z()), 0, 0});
+}
+
+// closed box of half-size h with each face split into m x m quads and
+// normals pointing inward, in RenderObject::vertexData() layout
+std::vector<float> tessellatedBox(double h, int m) {
+  std::vector<float> data;
+  for (int axis = 0; axis < 3; ++axis) {
+    for (int side = -1; side <= 1; side += 2) {
+      auto point = [&](double u, double v) {
+        double c[3];
+        c[axis] = side * h;
+        c[(axis + 1) % 3] = -h + 2 * h * u / m;
+        c[(axis + 2) % 3] = -h + 2 * h * v / m;
+        return Vec3(c[0], c[1], c[2]);
+      };
+      double nc[3] = {0, 0, 0};
+      nc[axis] = -side;
+      Vec3 n(nc[0], nc[1], nc[2]);
+      for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < m; ++j) {
+          Vec3 p00 = point(i, j), p10 = point(i + 1, j),
+               p11 = point(i + 1, j + 1), p01 = point(i, j + 1);
+          // wind so that the edge normals point into each triangle
+          bool flip = (p10 - p00).cross(p01 - p00).dot(n) < 0;
+          const Vec3 *ccw[6] = {&p00, &p10, &p11, &p00, &p11, &p01};
+          const Vec3 *cw[6] = {&p00, &p01, &p11, &p00, &p11, &p10};
+          for (const Vec3 *p : flip ? cw : ccw) {
+            pushVertex(data, *p, n);
+          }
+        }
+      }
+    }
+  }
+  return data;
+}
+
+void benchBoundary() {
+  std::cout << "boundary query: linear scan vs BVH\n";
+  std::cout << "  tris      linear ns/query   bvh ns/query   speedup   "
+               "max diff\n";
+  const double h = 20.0;
+  const int queries = 20000;
+  for (int m : {1, 9, 91}) { // 12, 972 and 99372 triangles
+    BoundaryCollider bounds(tessellatedBox(h, m));
+
+    // half the spheres touch a wall, one in ten has been pushed past one,
+    // up to twice the largest radius, and the rest float inside
+    std::uniform_real_distribution<double> inside(-h + 1.5, h - 1.5);
+    std::uniform_real_distribution<double> nearWall(h - 1.0, h - 0.2);
+    std::uniform_real_distribution<double> pastWall(h - 0.5, h + 4.0);
+    std::uniform_real_distribution<double> radiusDist(0.8, 2.0);
+    std::uniform_int_distribution<int> axisDist(0, 5);
+    std::vector<Vec3> pos(queries);
+    std::vector<double> radius(queries);
+    for (int i = 0; i < queries; ++i) {
+      double c[3] = {inside(benchRng), inside(benchRng), inside(benchRng)};
+      if (i % 10 < 6) {
+        int a = axisDist(benchRng);
+        c[a % 3] = (a < 3 ? 1 : -1) *
+                   (i % 10 < 5 ? nearWall(benchRng) : pastWall(benchRng));
+      }
+      pos[i] = Vec3(c[0], c[1], c[2]);
+      radius[i] = radiusDist(benchRng);
+    }
+
+    // the linear scan is slow at 100k triangles; time a subset
+    int linearQueries = bounds.tris().size() > 10000 ? queries / 20 : queries;
+    std::vector<Vec3> linearResult(linearQueries);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < linearQueries; ++i) {
+      linearResult[i] = bounds.outsideOffset(pos[i], radius[i]);
+    }
+    double linearNs = msSince(t0) * 1e6 / linearQueries;
+
+    std::vector<Vec3> bvhResult(queries);
+    t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < queries; ++i) {
+      bvhResult[i] = bounds.contactOffset(pos[i], radius[i]);
+    }
+    double bvhNs = msSince(t0) * 1e6 / queries;
+
+    double maxDiff = 0;
+    for (int i = 0; i < linearQueries; ++i) {
+      maxDiff = std::max(maxDiff, (linearResult[i] - bvhResult[i]).mag());
+    }
+    std::printf("  %-9zu %-17.1f %-14.1f %-9.1f %.2e\n", bounds.tris().size(),
+                linearNs, bvhNs, linearNs / bvhNs, maxDiff);
+  }
+}
+
+void benchGravity() {
+  std::cout << "mutual gravity: Barnes-Hut tree vs direct sum\n";
+  std::cout << "  bodies    theta  build ms  tree ns/body  direct ns/body  "
+               "rms err   max err\n";
+  const double eps = 0.05;
+  const int sample = 200; // bodies checked against the direct sum
+  for (int n : {1000, 10000, 100000}) {
+    // a dense core in a sparse halo, masses spread over 0.1 to 1
+    std::normal_distribution<double> core(0, 5), halo(0, 40);
+    std::uniform_real_distribution<double> massDist(0.1, 1.0);
+    Vec3Array pos;
+    std::vector<Real> mass(n);
+    for (int i = 0; i < n; ++i) {
+      std::normal_distribution<double> &d = i % 4 == 0 ? halo : core;
+      pos.push_back(Vec3(d(benchRng), d(benchRng), d(benchRng)));
+      mass[i] = massDist(benchRng);
+    }
+    GravityTree tree;
+    for (double theta : {0.3, 0.5, 0.8}) {
+      auto t0 = std::chrono::steady_clock::now();
+      tree.build(pos, mass);
+      double buildMs = msSince(t0);
+
+      std::vector<Vec3> treeAccel(n);
+      t0 = std::chrono::steady_clock::now();
+      for (int i = 0; i < n; ++i) {
+        treeAccel[i] = tree.accel(i, theta, eps);
+      }
+      double treeNs = msSince(t0) * 1e6 / n;
+
+      // relative error of the force on a sample of bodies
+      double sumSq = 0, maxErr = 0;
+      t0 = std::chrono::steady_clock::now();
+      for (int k = 0; k < sample; ++k) {
+        int i = k * (n / sample);
+        Vec3 exact = tree.directAccel(i, eps);
+        double err = (treeAccel[i] - exact).mag() / exact.mag();
+        sumSq += err * err;
+        maxErr = std::max(maxErr, err);
+      }
+      double directNs = msSince(t0) * 1e6 / sample;
+      std::printf("  %-9d %-6.1f %-9.2f %-13.0f %-15.0f %-9.2e %.2e\n", n,
+                  theta, buildMs, treeNs, directNs,
+                  std::sqrt(sumSq / sample), maxErr);
+    }
+  }
+}
+
+void benchBroadphase() {
+  std::cout << "broadphase: uniform grid rebuild vs sweep and prune update\n";
+  std::cout << "  balls     radii        grid ms/step  grid cand/ball  "
+               "sap ms/step  sap cand/ball  swaps/step\n";
+  const int steps = 20;
+  for (int n : {1000, 10000, 100000}) {
+    for (double rMax : {0.5, 2.0}) {
+      // balls of radius 0.2 to rMax at about 5% volume fraction, each
+      // moving a tenth of the smallest radius per step
+      double rMin = 0.2;
+      std::uniform_real_distribution<double> radiusDist(rMin, rMax);
+      std::vector<Real> radius(n);
+      double volume = 0;
+      for (int i = 0; i < n; ++i) {
+        radius[i] = radiusDist(benchRng);
+        volume += 4.19 * std::pow(radius[i], 3);
+      }
+      double side = std::cbrt(volume / 0.05);
+      std::uniform_real_distribution<double> place(0, side), dir(-1, 1);
+      Vec3Array pos, vel;
+      for (int i = 0; i < n; ++i) {
+        pos.push_back(Vec3(place(benchRng), place(benchRng), place(benchRng)));
+        vel.push_back(Vec3(dir(benchRng), dir(benchRng), dir(benchRng)).unit() *
+                      (0.1 * rMin));
+      }
+      auto move = [&]() {
+        for (int i = 0; i < n; ++i) {
+          pos.add(i, vel.get(i));
+        }
+      };
+      long candidates = 0;
+      auto count = [&](int j) { candidates++; };
+
+      UniformGrid grid;
+      double gridMs = 0;
+      for (int s = 0; s < steps; ++s) {
+        move();
+        auto t0 = std::chrono::steady_clock::now();
+        grid.build(pos, 2 * rMax);
+        for (int i = 0; i < n; ++i) {
+          grid.forEachNear(i, count);
+        }
+        gridMs += msSince(t0);
+      }
+      double gridCand = double(candidates) / (steps * n);
+
+      // the first update sorts from scratch; time the incremental ones
+      SweepAndPrune sweep;
+      sweep.update(pos, radius);
+      long swaps0 = sweep.swaps();
+      candidates = 0;
+      double sapMs = 0;
+      for (int s = 0; s < steps; ++s) {
+        move();
+        auto t0 = std::chrono::steady_clock::now();
+        sweep.update(pos, radius);
+        for (int i = 0; i < n; ++i) {
+          sweep.forEachNear(i, count);
+        }
+        sapMs += msSince(t0);
+      }
+      std::printf("  %-9d 0.2 to %-5.1f %-13.2f %-15.1f %-12.2f %-14.2f %ld\n",
+                  n, rMax, gridMs / steps, gridCand, sapMs / steps,
+                  double(candidates) / (steps * n),
+                  (sweep.swaps() - swaps0) / steps);
+    }
+  }
+
+  // swept-box queries (continuous collision detection) with a few balls
+  // that diverged to huge, infinite or NaN positions: every query must
+  // return, and still find every finite ball inside its box
+  std::uniform_real_distribution<double> place(0, 100);
+  Vec3Array pos;
+  for (int i = 0; i < 1000; ++i) {
+    pos.push_back(Vec3(place(benchRng), place(benchRng), place(benchRng)));
+  }
+  for (const Vec3 &p : {Vec3(3e9, -2e9, 1e9), Vec3(1e300, 50, 50),
+                        Vec3(INFINITY, 50, 50), Vec3(NAN, 50, 50)}) {
+    pos.push_back(p);
+  }
+  UniformGrid grid;
+  grid.build(pos, 2.0);
+  const Vec3 boxes[][2] = {{Vec3(10, 10, 10), Vec3(30, 30, 30)},
+                           {Vec3(-1, -3e9, -1), Vec3(4e9, 101, 2e9)},
+                           {Vec3(-INFINITY, 0, 0), Vec3(INFINITY, 100, 100)},
+                           {Vec3(NAN, 0, 0), Vec3(50, 50, 50)}};
+  long missed = 0, inside = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (const Vec3 *box : boxes) {
+    std::vector<unsigned char> found(pos.size(), false);
+    grid.forEachInBox(box[0], box[1], [&](int j) { found[j] = true; });
+    for (int j = 0; j < pos.size(); ++j) {
+      Vec3 p = pos.get(j);
+      if (p.x() >= box[0].x() && p.x() <= box[1].x() &&
+          p.y() >= box[0].y() && p.y() <= box[1].y() &&
+          p.z() >= box[0].z() && p.z() <= box[1].z() &&
+          std::isfinite(p.mag())) {
+        inside++;
+        missed += !found[j];
+      }
+    }
+  }
+  std::printf("  diverged balls: box queries missed %ld of %ld balls "
+              "inside, %.2f ms\n",
+              missed, inside, msSince(t0));
+}
+
+// hardware cache misses of this thread (PERF_COUNT_HW_CACHE_MISSES, the
+// last level), or -1 where the kernel or a virtual machine has no counter
+class MissCounter {
+public:
+  MissCounter() {
+#ifdef __linux__
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    _fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+  };
+  ~MissCounter() {
+#ifdef __linux__
+    if (_fd >= 0) {
+      close(_fd);
+    }
+#endif
+  };
+
+  void start() {
+#ifdef __linux__
+    if (_fd >= 0) {
+      ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  };
+  long long stop() {
+    long long count = -1;
+#ifdef __linux__
+    if (_fd >= 0) {
+      ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(_fd, &count, sizeof(count)) != sizeof(count)) {
+        count = -1;
+      }
+    }
+#endif
+    return count;
+  };
+
+private:
+  int _fd = -1;
+};
+
+// set-associative LRU cache of 64 byte lines, counting the misses of the
+// addresses fed to it; a machine-independent stand-in for MissCounter
+class CacheModel {
+public:
+  CacheModel(int bytes, int ways)
+      : _ways(ways), _sets(bytes / 64 / ways), _tags(_sets * ways, -1) {};
+
+  void access(const void *p) {
+    long long line = reinterpret_cast<uintptr_t>(p) / 64;
+    long long *set = &_tags[(line % _sets) * _ways];
+    int k = 0;
+    while (k < _ways - 1 && set[k] != line) {
+      ++k;
+    }
+    if (set[k] != line) {
+      _misses++;
+    }
+    // move to the front, most recent first
+    for (; k > 0; --k) {
+      set[k] = set[k - 1];
+    }
+    set[0] = line;
+  };
+  long misses() const { return _misses; };
+
+private:
+  int _ways, _sets;
+  std::vector<long long> _tags;
+  long _misses = 0;
+};
+
+void benchReorder() {
+  std::cout << "morton reorder: contact pass in creation vs Morton order\n";
+  std::cout << "  balls     order     ms/pass  hw misses/ball  "
+               "L1 misses/ball  L2 misses/ball  reorder ms\n";
+  for (int n : {10000, 100000, 1000000}) {
+    int passes = std::max(1, 1000000 / n);
+    // balls of radius 0.5 at about 30% volume fraction, created in random
+    // places, as after a scene has been stirred for a while
+    double side = std::cbrt(n * 0.524 / 0.3);
+    std::uniform_real_distribution<double> place(0, side);
+    Vec3Array pos, force;
+    std::vector<Real> radius(n, 0.5);
+    for (int i = 0; i < n; ++i) {
+      pos.push_back(Vec3(place(benchRng), place(benchRng), place(benchRng)));
+      force.push_back(Vec3(0, 0, 0));
+    }
+    for (bool sorted : {false, true}) {
+      double reorderMs = 0;
+      if (sorted) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<int> order = mortonOrder(pos, 1.0);
+        Vec3Array moved;
+        for (int k = 0; k < n; ++k) {
+          moved.push_back(pos.get(order[k]));
+        }
+        pos = moved;
+        reorderMs = msSince(t0);
+      }
+      UniformGrid grid;
+      grid.build(pos, 1.0);
+      // spring forces of overlapping pairs, as the penalty contact pass
+      auto contacts = [&](CacheModel *l1, CacheModel *l2) {
+        for (int i = 0; i < n; ++i) {
+          Vec3R pi = pos.get(i);
+          grid.forEachNear(i, [&](int j) {
+            if (l1) {
+              for (const void *p : {(const void *)&pos.x[j],
+                                    (const void *)&pos.y[j],
+                                    (const void *)&pos.z[j],
+                                    (const void *)&radius[j]}) {
+                l1->access(p);
+                l2->access(p);
+              }
+            }
+            Vec3R d = pos.get(j) - pi;
+            Real depth = radius[i] + radius[j] - d.mag();
+            if (j != i && depth > 0) {
+              force.add(i, d.unit() * -depth);
+            }
+          });
+        }
+      };
+      MissCounter counter;
+      counter.start();
+      auto t0 = std::chrono::steady_clock::now();
+      for (int p = 0; p < passes; ++p) {
+        contacts(nullptr, nullptr);
+      }
+      double ms = msSince(t0) / passes;
+      long long hw = counter.stop();
+      CacheModel l1(32 << 10, 8), l2(1 << 20, 16);
+      contacts(&l1, &l2);
+      char hwText[32] = "n/a";
+      if (hw >= 0) {
+        std::snprintf(hwText, sizeof(hwText), "%.2f", double(hw) / passes / n);
+      }
+      std::printf("  %-9d %-9s %-8.2f %-15s %-15.2f %-15.2f %.1f\n", n,
+                  sorted ? "morton" : "creation", ms, hwText,
+                  double(l1.misses()) / n, double(l2.misses()) / n, reorderMs);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  benchBoundary();
+  benchGravity();
+  benchBroadphase();
+  benchReorder();
+  return 0;
+}
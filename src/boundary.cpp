@@ -0,0 +1,245 @@
+#include "boundary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// triangles per BVH leaf
+const int LEAF_SIZE = 4;
+// meshes up to this size are a single leaf; traversal would cost more than
+// the triangle tests it saves
+const int SINGLE_LEAF_TRIS = 32;
+
+BoundaryCollider::BoundaryCollider() {}
+
+BoundaryCollider::BoundaryCollider(const std::vector<float> &vertexData) {
+  const int stride = 8;
+  _tris.reserve(vertexData.size() / (3 * stride));
+  for (int i = 0; i + 3 * stride <= int(vertexData.size()); i += 3 * stride) {
+    const float *v = &vertexData[i];
+    BoundaryTri tri;
+    tri.a = Vec3(v[0], v[1], v[2]);
+    tri.b = Vec3(v[stride], v[stride + 1], v[stride + 2]);
+    tri.c = Vec3(v[2 * stride], v[2 * stride + 1], v[2 * stride + 2]);
+    // the first vertex normal stands in for the face normal
+    tri.n = Vec3(v[3], v[4], v[5]);
+    tri.d = tri.n.dot(tri.a);
+    // (b - a).cross(p - a).dot(n) > 0 is the same test as
+    // n.cross(b - a).dot(p - a) > 0, so each edge becomes a plane
+    const Vec3 *verts[3] = {&tri.a, &tri.b, &tri.c};
+    for (int e = 0; e < 3; ++e) {
+      const Vec3 &p0 = *verts[e];
+      const Vec3 &p1 = *verts[(e + 1) % 3];
+      tri.edgeN[e] = tri.n.cross(p1 - p0);
+      tri.edgeD[e] = tri.edgeN[e].dot(p0);
+    }
+    _tris.push_back(tri);
+  }
+  buildTree();
+}
+
+BoundaryCollider BoundaryCollider::fromObjFile(const std::string &fileName) {
+  std::ifstream file(fileName);
+  if (!file) {
+    std::cerr << "warning: could not open boundary \"" << fileName
+              << "\"; environment has no walls\n";
+    return BoundaryCollider();
+  }
+  std::vector<Vec3> verts, normals;
+  std::vector<float> vertexData;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream tokens(line);
+    std::string type;
+    tokens >> type;
+    if (type == "v" || type == "vn") {
+      double x, y, z;
+      tokens >> x >> y >> z;
+      (type == "v" ? verts : normals).push_back(Vec3(x, y, z));
+    } else if (type == "f") {
+      // vertex references are v, v/vt, v//vn or v/vt/vn, 1-based or
+      // negative (relative to the end of the list)
+      std::vector<int> vIdx, nIdx;
+      std::string ref;
+      while (tokens >> ref) {
+        std::vector<std::string> parts;
+        std::istringstream refTokens(ref);
+        for (std::string part; std::getline(refTokens, part, '/');) {
+          parts.push_back(part);
+        }
+        int v = std::stoi(parts[0]);
+        int n = parts.size() > 2 && !parts[2].empty() ? std::stoi(parts[2]) : 0;
+        vIdx.push_back(v < 0 ? verts.size() + v : v - 1);
+        nIdx.push_back(n == 0 ? -1 : (n < 0 ? normals.size() + n : n - 1));
+      }
+      for (int k = 1; k + 1 < int(vIdx.size()); ++k) {
+        int corners[3] = {0, k, k + 1};
+        Vec3 faceN = (verts[vIdx[k]] - verts[vIdx[0]])
+                         .cross(verts[vIdx[k + 1]] - verts[vIdx[0]])
+                         .unit();
+        for (int c : corners) {
+          const Vec3 &p = verts[vIdx[c]];
+          const Vec3 &n = nIdx[c] == -1 ? faceN : normals[nIdx[c]];
+          vertexData.insert(vertexData.end(),
+                            {float(p.x()), float(p.y()), float(p.z()),
+                             float(n.x()), float(n.y()), float(n.z()), 0, 0});
+        }
+      }
+    }
+  }
+  return BoundaryCollider(vertexData);
+}
+
+void BoundaryCollider::buildTree() {
+  _nodes.clear();
+  if (_tris.empty()) {
+    return;
+  }
+  std::vector<int> order(_tris.size());
+  std::vector<Vec3> centroids(_tris.size());
+  for (int k = 0; k < 3; ++k) {
+    _lo[k] = INFINITY;
+    _hi[k] = -INFINITY;
+  }
+  for (int i = 0; i < int(_tris.size()); ++i) {
+    order[i] = i;
+    centroids[i] = (_tris[i].a + _tris[i].b + _tris[i].c) / 3.0;
+    for (const Vec3 *v : {&_tris[i].a, &_tris[i].b, &_tris[i].c}) {
+      double p[3] = {v->x(), v->y(), v->z()};
+      for (int k = 0; k < 3; ++k) {
+        _lo[k] = std::min(_lo[k], p[k]);
+        _hi[k] = std::max(_hi[k], p[k]);
+      }
+    }
+  }
+  _nodes.reserve(2 * _tris.size() / LEAF_SIZE + 1);
+  buildNode(order, centroids, 0, _tris.size());
+
+  // store triangles in leaf order so each leaf is a contiguous range
+  std::vector<BoundaryTri> sorted;
+  sorted.reserve(_tris.size());
+  for (int i : order) {
+    sorted.push_back(_tris[i]);
+  }
+  _tris.swap(sorted);
+}
+
+// median split along the longest axis of the centroid bounds
+int BoundaryCollider::buildNode(std::vector<int> &order,
+                                std::vector<Vec3> &centroids, int begin,
+                                int end) {
+  int nodeIdx = _nodes.size();
+  _nodes.push_back(BoundaryNode());
+  BoundaryNode node;
+  double cLo[3] = {INFINITY, INFINITY, INFINITY};
+  double cHi[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (int k = 0; k < 3; ++k) {
+    node.lo[k] = INFINITY;
+    node.hi[k] = -INFINITY;
+  }
+  for (int i = begin; i < end; ++i) {
+    const BoundaryTri &tri = _tris[order[i]];
+    for (const Vec3 *v : {&tri.a, &tri.b, &tri.c}) {
+      double p[3] = {v->x(), v->y(), v->z()};
+      for (int k = 0; k < 3; ++k) {
+        node.lo[k] = std::min(node.lo[k], p[k]);
+        node.hi[k] = std::max(node.hi[k], p[k]);
+      }
+    }
+    // a sphere any depth behind the face still gets its wall force, so
+    // cover the space behind it up to the mesh bounds; for an axis-aligned
+    // face of a closed boundary that adds nothing
+    double n[3] = {tri.n.x(), tri.n.y(), tri.n.z()};
+    for (int k = 0; k < 3; ++k) {
+      if (n[k] > 0) {
+        node.lo[k] = _lo[k];
+      } else if (n[k] < 0) {
+        node.hi[k] = _hi[k];
+      }
+    }
+    double c[3] = {centroids[order[i]].x(), centroids[order[i]].y(),
+                   centroids[order[i]].z()};
+    for (int k = 0; k < 3; ++k) {
+      cLo[k] = std::min(cLo[k], c[k]);
+      cHi[k] = std::max(cHi[k], c[k]);
+    }
+  }
+
+  if (end - begin <= LEAF_SIZE || _tris.size() <= SINGLE_LEAF_TRIS) {
+    node.first = begin;
+    node.count = end - begin;
+    _nodes[nodeIdx] = node;
+    return nodeIdx;
+  }
+
+  int axis = 0;
+  for (int k = 1; k < 3; ++k) {
+    if (cHi[k] - cLo[k] > cHi[axis] - cLo[axis]) {
+      axis = k;
+    }
+  }
+  int mid = (begin + end) / 2;
+  std::nth_element(order.begin() + begin, order.begin() + mid,
+                   order.begin() + end, [&](int i, int j) {
+                     const Vec3 &ci = centroids[i], &cj = centroids[j];
+                     return axis == 0   ? ci.x() < cj.x()
+                            : axis == 1 ? ci.y() < cj.y()
+                                        : ci.z() < cj.z();
+                   });
+  buildNode(order, centroids, begin, mid);
+  node.first = buildNode(order, centroids, mid, end);
+  node.count = 0;
+  _nodes[nodeIdx] = node;
+  return nodeIdx;
+}
+
+Vec3 BoundaryCollider::outsideOffset(const Vec3 &pos, double radius) const {
+  Vec3 result;
+  for (const BoundaryTri &tri : _tris) {
+    double distToPlane = tri.n.dot(pos) - tri.d;
+    if (distToPlane < radius && tri.projectsInside(pos)) {
+      result += tri.n * (distToPlane - radius);
+    }
+  }
+  return result;
+}
+
+Vec3 BoundaryCollider::contactOffset(const Vec3 &pos, double radius) const {
+  Vec3 result;
+  forEachContact(pos, radius, [&](const BoundaryTri &tri, double distToPlane) {
+    result += tri.n * (distToPlane - radius);
+  });
+  return result;
+}
+
+double BoundaryCollider::sweep(const Vec3 &from, const Vec3 &to,
+                               double radius, Vec3 &normal) const {
+  double lo[3] = {std::min(from.x(), to.x()) - radius,
+                  std::min(from.y(), to.y()) - radius,
+                  std::min(from.z(), to.z()) - radius};
+  double hi[3] = {std::max(from.x(), to.x()) + radius,
+                  std::max(from.y(), to.y()) + radius,
+                  std::max(from.z(), to.z()) + radius};
+  double result = INFINITY;
+  forEachTriIn(lo, hi, [&](const BoundaryTri &tri) {
+    double d0 = tri.n.dot(from) - tri.d;
+    double d1 = tri.n.dot(to) - tri.d;
+    // moving away from the face, not reaching it, or already through it
+    if (d1 >= d0 || d1 >= radius || d0 <= -radius) {
+      return;
+    }
+    double t = std::max((d0 - radius) / (d0 - d1), 0.0);
+    // the sphere reaches the face where its center is one radius away;
+    // edges and corners are caught where the center itself crosses
+    double tCenter = std::clamp(d0 / (d0 - d1), 0.0, 1.0);
+    if (t < result &&
+        (tri.projectsInside(from + (to - from) * t) ||
+         tri.projectsInside(from + (to - from) * tCenter))) {
+      result = t;
+      normal = tri.n;
+    }
+  });
+  return result;
+}
@@ -0,0 +1,140 @@
+/* Collision geometry of the environment boundary mesh. Triangles are
+    decoded once and stored with their face plane and edge planes so that
+    wall tests don't touch the render mesh, and are indexed by a bounding
+    volume hierarchy so contact queries only visit nearby triangles. */
+
+#ifndef BOUNDARY_H
+#define BOUNDARY_H
+
+#include <string>
+#include <vector>
+
+#include "vec3d.h"
+
+struct BoundaryTri {
+  Vec3 a, b, c;    // vertices
+  Vec3 n;          // face normal (points into the environment)
+  double d;        // plane offset; n.dot(p) - d is distance to plane
+  Vec3 edgeN[3];   // in-plane edge normals (ab, bc, ca), pointing inward
+  double edgeD[3]; // edge offsets; edgeN.dot(p) - edgeD > 0 inside edge
+
+  // edge normals are perpendicular to n, so testing pos is the same as
+  // testing its projection onto the plane
+  bool projectsInside(const Vec3 &pos) const {
+    return edgeN[0].dot(pos) > edgeD[0] && edgeN[1].dot(pos) > edgeD[1] &&
+           edgeN[2].dot(pos) > edgeD[2];
+  };
+};
+
+// BVH node; nodes are stored depth first, so the left child of an inner
+// node is the next node
+struct BoundaryNode {
+  // bounds of all triangles below this node and of the space behind them,
+  // within the mesh bounds
+  double lo[3], hi[3];
+  int first;           // leaf: first triangle; inner: right child
+  int count;           // triangles in leaf (0 for inner nodes)
+};
+
+class BoundaryCollider {
+public:
+  BoundaryCollider();
+  // interleaved vertex data as produced by RenderObject::vertexData()
+  // (position, normal, texture coordinate; three vertices per triangle)
+  BoundaryCollider(const std::vector<float> &vertexData);
+  // read a Wavefront OBJ directly (no render mesh needed); polygons are
+  // split into triangle fans. empty if the file can't be read
+  static BoundaryCollider fromObjFile(const std::string &fileName);
+
+  const std::vector<BoundaryTri> &tris() const { return _tris; };
+  const std::vector<BoundaryNode> &nodes() const { return _nodes; };
+  bool empty() const { return _tris.empty(); };
+  // bounds of all vertices (zero when empty)
+  const double *lo() const { return _lo; };
+  const double *hi() const { return _hi; };
+
+  // offset of a sphere outside the boundary (zero if fully inside); tests
+  // every triangle, so points far behind a face are still reported
+  Vec3 outsideOffset(const Vec3 &pos, double radius) const;
+  // same offset through the BVH; used for per-step wall contacts
+  Vec3 contactOffset(const Vec3 &pos, double radius) const;
+  // call f(tri, distToPlane) for each triangle the sphere touches or is
+  // behind, as outsideOffset tests them, in the order contactOffset sums
+  // them
+  template <typename F>
+  void forEachContact(const Vec3 &pos, double radius, F f) const;
+  // fraction of the way from `from` to `to` at which a sphere moving
+  // between them first touches a triangle from its inner side, or
+  // INFINITY if it doesn't; normal is set to the face normal of that
+  // triangle. spheres already touching a face count at 0 if they move
+  // towards it
+  double sweep(const Vec3 &from, const Vec3 &to, double radius,
+               Vec3 &normal) const;
+
+  // call f(tri) for each triangle in a leaf whose bounds overlap [lo, hi];
+  // may include triangles outside the box
+  template <typename F>
+  void forEachTriIn(const double lo[3], const double hi[3], F f) const;
+
+private:
+  void buildTree();
+  int buildNode(std::vector<int> &order, std::vector<Vec3> &centroids,
+                int begin, int end);
+
+  std::vector<BoundaryTri> _tris; // in BVH leaf order
+  std::vector<BoundaryNode> _nodes;
+  double _lo[3] = {0, 0, 0}, _hi[3] = {0, 0, 0};
+};
+
+template <typename F>
+void BoundaryCollider::forEachTriIn(const double lo[3], const double hi[3],
+                                    F f) const {
+  if (_nodes.empty()) {
+    return;
+  }
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const BoundaryNode &node = _nodes[stack[--top]];
+    if (node.lo[0] > hi[0] || node.hi[0] < lo[0] || node.lo[1] > hi[1] ||
+        node.hi[1] < lo[1] || node.lo[2] > hi[2] || node.hi[2] < lo[2]) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; ++i) {
+        f(_tris[i]);
+      }
+    } else {
+      stack[top++] = node.first;
+      stack[top++] = &node - &_nodes[0] + 1;
+    }
+  }
+}
+
+template <typename F>
+void BoundaryCollider::forEachContact(const Vec3 &pos, double radius,
+                                      F f) const {
+  auto test = [&](const BoundaryTri &tri) {
+    double distToPlane = tri.n.dot(pos) - tri.d;
+    if (distToPlane < radius && tri.projectsInside(pos)) {
+      f(tri, distToPlane);
+    }
+  };
+  double c[3] = {pos.x(), pos.y(), pos.z()};
+  for (int k = 0; k < 3; ++k) {
+    // node bounds only reach behind their faces as far as the mesh bounds;
+    // a ball that left them is rare enough to test every triangle
+    if (!(c[k] >= _lo[k] && c[k] <= _hi[k])) {
+      for (const BoundaryTri &tri : _tris) {
+        test(tri);
+      }
+      return;
+    }
+  }
+  double lo[3] = {c[0] - radius, c[1] - radius, c[2] - radius};
+  double hi[3] = {c[0] + radius, c[1] + radius, c[2] + radius};
+  forEachTriIn(lo, hi, test);
+}
+
+#endif
@@ -74,10 +74,10 @@ void CursorEmulator::update() {
       // (*ctrls)("angularAxisY").setValue(current.angularAxis.y());
       // (*ctrls)("angularAxisZ").setValue(current.angularAxis.z());
 
-      Environment *env = static_cast<Environment *>(_win->userPointer("env"));
-      if (env->objs().size() > 20) {
+      int objCount = simUtils::envSnapshot(*_win).size();
+      if (objCount > 20) {
         double deleteObjs = actionDist(rng);
-        if (deleteObjs < (1 - std::exp(-0.015 * env->objs().size())))
+        if (deleteObjs < (1 - std::exp(-0.015 * objCount)))
           clearEnv();
       }
       double nextAction = actionDist(rng);
@@ -227,11 +227,7 @@ void CursorEmulator::createObj() {
 }
 
 void CursorEmulator::clearEnv() {
-  Environment *env = static_cast<Environment *>(_win->userPointer("env"));
-  for (auto &obj : env->objs()) {
-    _win->activeScene()->removeRenderObject(obj.first);
-  }
-  env->clearObjs();
+  simUtils::clearEnvObjs(*(GraphicsTools::Window *)_win);
 }
 
 void CursorEmulator::doAction() {
@@ -1,18 +1,50 @@
 #include "env3d.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <vector>
 
 #include "bbox.h"
+#include "forceKernels.h"
+#include "profiler.h"
 #include "vec3d.h"
 
 // global simulation parameters (from XML config file)
 extern SimParameters simParams;
 
-Environment::Environment() : _dt(0), _t(0) {}
+// checkpoint file layout, all in native byte order:
+//   magic "GSIM", uint32 version, uint8 sizeof(Real), double dt, int32 step
+//   count, int32 next object ID, uint8 paused, int32 ball count, then the
+//   ball arrays from BallStore::write
+static const char SNAPSHOT_MAGIC[4] = {'G', 'S', 'I', 'M'};
+static const uint32_t SNAPSHOT_VERSION = 5;
+
+template <typename T> static void writeValue(std::ostream &out, T v) {
+  out.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <typename T> static bool readValue(std::istream &in, T &v) {
+  return bool(in.read(reinterpret_cast<char *>(&v), sizeof(T)));
+}
+
+Environment::Environment()
+    : _dt(0), _stepDt(0), _adaptDt(0), _t(0), _steps(0), _reorderedAt(0),
+      _forceEvals(0) {}
 
 Environment::Environment(const Vec3 &gravity, double timeStep)
-    : _dt(timeStep), _g(gravity), _nextObjId(0), _paused(false), _t(0) {
-  std::cerr << "env create gravity " << _g << " dt " << _dt << "\n";
+    : _dt(timeStep), _stepDt(timeStep),
+      _adaptDt(simParams.environment_minStep), _g(gravity), _nextObjId(0),
+      _paused(false), _t(0), _steps(0), _reorderedAt(0), _forceEvals(0) {
+  int threads = simParams.environment_threads > 0
+                    ? simParams.environment_threads
+                    : std::thread::hardware_concurrency();
+  if (threads > 1) {
+    _pool = std::make_unique<ThreadPool>(threads);
+  }
+  std::cerr << "env create gravity " << _g << " dt " << _dt << " threads "
+            << (_pool ? _pool->size() : 1) << "\n";
 }
 
 Environment::~Environment() {
@@ -20,104 +52,1016 @@ Environment::~Environment() {
   std::cerr << "env delete\n";
 };
 
+// colliding pairs found by the calling thread, not yet resolved
+static ContactBatch &contactBatch() {
+  thread_local ContactBatch batch;
+  return batch;
+}
+
+void Environment::resolvePair(int i, int j, ContactBatch &batch) {
+  // sleep state only changes outside the contact pass, so reading it here
+  // is race free
+  if (_objs.sleeping[i] && (_objs.sleeping[j] || _objs.idleTime[j] > 0)) {
+    return;
+  }
+  Real depth = _objs.radius[i] + _objs.radius[j] -
+               (_objs.pos.get(j) - _objs.pos.get(i)).mag();
+  if (depth > 0) {
+    if (_objs.sleeping[i]) {
+      _objs.wakeUp[i] = true;
+    }
+    _penetration[i] = std::max(_penetration[i], depth);
+    batch.add(_objs, i, j);
+    if (batch.full()) {
+      addContactForces(batch, _objs);
+    }
+  }
+}
+
+void Environment::collideBruteForce(int begin, int end) {
+  // ignore object pairs where the objects are farther apart than twice the
+  // largest radius possible (since it's impossible for them to be
+  // colliding)
+  double maxDist =
+      2.0 * simParams.controls_radius[1] * simParams.environment_unitsPerMeter;
+  ContactBatch &batch = contactBatch();
+  for (int i = begin; i < end; ++i) {
+    for (int j = 0; j < _objs.size(); ++j) {
+      if (i != j && (_objs.pos.get(i) - _objs.pos.get(j)).mag() < maxDist) {
+        resolvePair(i, j, batch);
+      }
+    }
+  }
+  addContactForces(batch, _objs);
+}
+
+void Environment::collideCandidates(int begin, int end) {
+  ContactBatch &batch = contactBatch();
+  for (int i = begin; i < end; ++i) {
+    forEachCandidate(i, [&](int j) {
+      if (i != j) {
+        resolvePair(i, j, batch);
+      }
+    });
+  }
+  addContactForces(batch, _objs);
+}
+
+void Environment::buildBroadphase(double skin) {
+  Real scale = Real(1 + skin);
+  Real margin = 0;
+  if (simParams.environment_neighborLists) {
+    if (!_neighbors.stale(_objs.pos, scale)) {
+      return;
+    }
+    margin = Real(simParams.environment_neighborSkin *
+                  simParams.environment_unitsPerMeter);
+  }
+  switch (Broadphase(simParams.environment_broadphase)) {
+  case Broadphase::UniformGrid:
+    // cells as wide as the largest possible ball, so colliding balls are
+    // never more than one cell apart
+    _grid.build(_objs.pos, 2.0 * scale * simParams.controls_radius[1] *
+                                   simParams.environment_unitsPerMeter +
+                               margin);
+    break;
+  case Broadphase::SweepAndPrune:
+    _sweep.update(_objs.pos, _objs.radius, scale, Real(0.5) * margin);
+    break;
+  default:
+    break;
+  }
+  if (simParams.environment_neighborLists) {
+    _neighbors.build(_objs.pos, _objs.radius, scale, margin,
+                     [this](int i, const std::function<void(int)> &f) {
+                       forEachIndexed(i, f);
+                     });
+  }
+}
+
+void Environment::forSlots(const std::function<void(int, int)> &f) {
+  forChunks([&](int begin, int end, int chunk) { f(begin, end); });
+}
+
+void Environment::forChunks(const std::function<void(int, int, int)> &f) {
+  if (_pool) {
+    _pool->parallelFor(_objs.size(), f);
+  } else {
+    f(0, _objs.size(), 0);
+  }
+}
+
 void Environment::moveObjs() {
   // TODO delete objects very far from the origin (they probably fell off the edge)
-  // check for collisions
-  for (auto &obj1 : _objs) {
-    for (auto &obj2 : _objs) {
-      // ignore object pairs where the objects are farther apart than twice the
-      // largest radius possible (since it's impossible for them to be
-      // colliding)
-      if (obj1.first != obj2.first &&
-          obj1.second.bbox().distanceFrom(obj2.second.bbox()) <
-              2.0 * simParams.controls_radius[1] *
-                  simParams.environment_unitsPerMeter) {
-        if (obj1.second.collidesWith(_dt, obj2.second)) {
-          obj1.second.resolveCollision(obj2.second, _dt);
+  if (simParams.environment_ccd) {
+    _stepStart = _objs.pos;
+  }
+  if (ContactModel(simParams.environment_contacts) == ContactModel::Impulse) {
+    stepImpulses();
+  } else {
+    switch (Integrator(simParams.environment_integrator)) {
+    case Integrator::SymplecticEuler:
+      stepObjs<SymplecticEuler>();
+      break;
+    case Integrator::VelocityVerlet:
+      stepObjs<VelocityVerlet>();
+      break;
+    case Integrator::RK4:
+      stepObjs<RK4>();
+      break;
+    default:
+      stepObjs<ConstantAccelRK4>();
+      break;
+    }
+  }
+  if (simParams.environment_ccd) {
+    PROFILE_SCOPE(Phase::Collide);
+    sweepFastMovers();
+  }
+}
+
+// hits handled per ball and step; a ball still hitting something after
+// that stops at its last hit
+static const int CCD_PASSES = 4;
+
+void Environment::sweepFastMovers() {
+  // runs on one thread, in slot order, so pushes happen in the same order
+  // for any thread count
+  double maxR = 0;
+  std::vector<int> fast;
+  std::vector<double> moved(_objs.size(), 0), fastMoved;
+  for (int i = 0; i < _objs.size(); ++i) {
+    maxR = std::max<double>(maxR, _objs.radius[i]);
+    if (_objs.selected[i] || _objs.sleeping[i]) {
+      continue;
+    }
+    moved[i] = (Vec3R(_objs.pos.get(i)) - _stepStart.get(i)).mag();
+    if (moved[i] > simParams.environment_ccdMotion * _objs.radius[i]) {
+      fast.push_back(i);
+      fastMoved.push_back(moved[i]);
+    }
+  }
+  if (fast.empty()) {
+    return;
+  }
+  // cells fit most of the sweeps; the balls that moved further are tested
+  // apart, so when many are fast each sweep still sees few balls
+  auto tail = fastMoved.begin() + fastMoved.size() * 9 / 10;
+  std::nth_element(fastMoved.begin(), tail, fastMoved.end());
+  double cell = std::max(2 * maxR, *tail);
+  _ccdMovers.clear();
+  for (int i = 0; i < _objs.size(); ++i) {
+    if (moved[i] > cell) {
+      _ccdMovers.push_back(i);
+    }
+  }
+  _ccdGrid.build(_objs.pos, cell);
+  _ccdReach = maxR + cell;
+  _ccdMover.assign(_objs.size(), false);
+  for (int i : _ccdMovers) {
+    _ccdMover[i] = true;
+  }
+  for (int i : fast) {
+    double r = _objs.radius[i];
+    Vec3 from = _stepStart.get(i);
+    Vec3 to = _objs.pos.get(i);
+    double done = 0; // fraction of the step before `from`
+    for (int pass = 0;; ++pass) {
+      Vec3 wallN;
+      int j = -1;
+      double tWall = _bounds.sweep(from, to, r, wallN);
+      double t = sweepBalls(i, from, to, done, j);
+      if (tWall <= t) {
+        t = tWall;
+        j = -1;
+      }
+      if (t > 1) {
+        break;
+      }
+      from = from + (to - from) * t;
+      done += (1 - done) * t;
+      if (j < 0) {
+        bounceSwept(i, -1, -wallN);
+      } else {
+        // the other ball is moved back to the hit too, and carries on at
+        // its new velocity
+        Vec3 hitPos = sweptPos(j, done);
+        bounceSwept(i, j, (hitPos - from).unit());
+        if (!_objs.selected[j] && !_objs.sleeping[j]) {
+          carrySwept(j, hitPos, done);
+          if (!_ccdMover[j]) {
+            _ccdMover[j] = true;
+            _ccdMovers.push_back(j);
+          }
+        }
+      }
+      if (pass == CCD_PASSES - 1) {
+        to = from;
+        break;
+      }
+      to = from + Vec3(_objs.vel.get(i)) * ((1 - done) * _stepDt);
+    }
+    _objs.pos.set(i, to);
+  }
+}
+
+void Environment::carrySwept(int j, Vec3 from, double done) {
+  Vec3 to = from + Vec3(_objs.vel.get(j)) * ((1 - done) * _stepDt);
+  for (int pass = 0;; ++pass) {
+    Vec3 wallN;
+    double t = _bounds.sweep(from, to, _objs.radius[j], wallN);
+    if (t > 1) {
+      break;
+    }
+    from = from + (to - from) * t;
+    done += (1 - done) * t;
+    bounceSwept(j, -1, -wallN);
+    if (pass == CCD_PASSES - 1) {
+      to = from;
+      break;
+    }
+    to = from + Vec3(_objs.vel.get(j)) * ((1 - done) * _stepDt);
+  }
+  _objs.pos.set(j, to);
+}
+
+Vec3 Environment::sweptPos(int j, double done) const {
+  Vec3 start = _stepStart.get(j);
+  return start + (Vec3(_objs.pos.get(j)) - start) * done;
+}
+
+double Environment::sweepBalls(int i, const Vec3 &from, const Vec3 &to,
+                               double done, int &hit) const {
+  Vec3 move = to - from;
+  double result = INFINITY;
+  auto test = [&](int j) {
+    if (j == i) {
+      return;
+    }
+    // offset of j from i, and its change, over the rest of the step
+    Vec3 jFrom = sweptPos(j, done);
+    Vec3 s = jFrom - from;
+    Vec3 d = (Vec3(_objs.pos.get(j)) - jFrom) - move;
+    double sd = s.dot(d);
+    if (sd >= 0) {
+      return; // not closing in
+    }
+    double rsum = _objs.radius[i] + _objs.radius[j];
+    double c = s.dot(s) - rsum * rsum;
+    double t = 0; // already touching
+    if (c > 0) {
+      // first root of |s + t d| = rsum
+      double dd = d.dot(d);
+      double disc = sd * sd - dd * c;
+      if (disc < 0) {
+        return;
+      }
+      t = (-sd - std::sqrt(disc)) / dd;
+    }
+    // equal times go to the lowest slot, whatever order j comes in
+    if (t <= 1 && (t < result || (t == result && j < hit))) {
+      result = t;
+      hit = j;
+    }
+  };
+  for (int j : _ccdMovers) {
+    test(j);
+  }
+  // any other ball that can reach i's path ends its step near it
+  double pad = _objs.radius[i] + _ccdReach;
+  Vec3 lo(std::min(from.x(), to.x()) - pad, std::min(from.y(), to.y()) - pad,
+          std::min(from.z(), to.z()) - pad);
+  Vec3 hi(std::max(from.x(), to.x()) + pad, std::max(from.y(), to.y()) + pad,
+          std::max(from.z(), to.z()) + pad);
+  _ccdGrid.forEachInBox(lo, hi, [&](int j) {
+    if (!_ccdMover[j]) {
+      test(j);
+    }
+  });
+  return result;
+}
+
+void Environment::bounceSwept(int i, int j, const Vec3 &n) {
+  bool jMoves = j >= 0 && !_objs.selected[j] && !_objs.sleeping[j];
+  Vec3 vi = _objs.vel.get(i);
+  Vec3 vj = jMoves ? Vec3(_objs.vel.get(j)) : Vec3();
+  double vn = (vi - vj).dot(n);
+  if (j >= 0 && _objs.sleeping[j]) {
+    _objs.wakeUp[j] = true;
+  }
+  if (vn <= 0) {
+    return;
+  }
+  double elasticity = j < 0 ? _objs.elasticity[i]
+                            : std::min(_objs.elasticity[i],
+                                       _objs.elasticity[j]);
+  double invMi = 1 / _objs.mass[i];
+  double invMj = jMoves ? 1 / _objs.mass[j] : 0;
+  double impulse = (1 + elasticity) * vn / (invMi + invMj);
+  _objs.vel.set(i, vi - n * (impulse * invMi));
+  if (jMoves) {
+    _objs.vel.set(j, vj + n * (impulse * invMj));
+  }
+}
+
+template <typename I> void Environment::stepObjs() {
+  if (I::STAGES > 1) {
+    _scratch.resize(_objs.size());
+  }
+  for (int stage = 0; stage < I::STAGES; ++stage) {
+    forSlots([&](int begin, int end) { beginStage<I>(stage, begin, end); });
+    computeForces();
+    forSlots([&](int begin, int end) { advanceStage<I>(stage, begin, end); });
+  }
+}
+
+BallState Environment::gatherState(int i) const {
+  return {_objs.mass[i],       _objs.radius[i],    _objs.pos.get(i),
+          _objs.vel.get(i),    _objs.aVel.get(i),  _objs.rot[i],
+          _objs.accel.get(i),  _objs.aAccel.get(i), _objs.force.get(i),
+          _objs.torque.get(i)};
+}
+
+void Environment::scatterState(int i, const BallState &s) {
+  _objs.pos.set(i, s.pos);
+  _objs.vel.set(i, s.vel);
+  _objs.aVel.set(i, s.aVel);
+  _objs.rot[i] = s.rot;
+  _objs.accel.set(i, s.accel);
+  _objs.aAccel.set(i, s.aAccel);
+  _objs.force.set(i, s.force);
+  _objs.torque.set(i, s.torque);
+}
+
+template <typename I>
+void Environment::beginStage(int stage, int begin, int end) {
+  StageScratch unused;
+  for (int i = begin; i < end; ++i) {
+    if (stage == 0) {
+      if (_objs.sleeping[i] && _objs.wakeUp[i]) {
+        _objs.wake(i);
+      }
+      _objs.wakeUp[i] = false;
+    }
+    if (_objs.selected[i] || _objs.sleeping[i]) {
+      continue;
+    }
+    BallState s = gatherState(i);
+    I::begin(stage, Real(_stepDt), s, I::STAGES > 1 ? _scratch[i] : unused);
+    scatterState(i, s);
+  }
+}
+
+void Environment::computeForces() {
+  _penetration.assign(_objs.size(), 0);
+  _forceEvals += _objs.size();
+  {
+    PROFILE_SCOPE(Phase::Collide);
+    buildBroadphase();
+    if (Broadphase(simParams.environment_broadphase) ==
+            Broadphase::BruteForce &&
+        !simParams.environment_neighborLists) {
+      forSlots([this](int begin, int end) { collideBruteForce(begin, end); });
+    } else {
+      forSlots([this](int begin, int end) { collideCandidates(begin, end); });
+    }
+  }
+  buildGravityTree();
+  forSlots([this](int begin, int end) { addBodyAndWallForces(begin, end); });
+}
+
+void Environment::addBodyAndWallForces(int begin, int end) {
+  // per-ball phase times are summed over all worker threads
+  PROFILE_LAP_TIMER(timer);
+  addBodyForces(_objs, begin, end, _g, _wind, _airDensity);
+  PROFILE_LAP(timer, Phase::BodyForces);
+  addMutualGravity(begin, end);
+  PROFILE_LAP(timer, Phase::Gravity);
+  for (int i = begin; i < end; ++i) {
+    if (_objs.selected[i] || _objs.sleeping[i]) {
+      continue;
+    }
+    Vec3R vel = _objs.vel.get(i);
+    Vec3R aVel = _objs.aVel.get(i);
+    Vec3R force = _objs.force.get(i);
+    Vec3R torque = _objs.torque.get(i);
+    Real r = _objs.radius[i];
+    // record x and y offsets of object outside the environment
+    Vec3R outsideEnv(_bounds.contactOffset(_objs.pos.get(i), r));
+    _penetration[i] = std::max(_penetration[i], outsideEnv.mag());
+    PROFILE_LAP(timer, Phase::Boundary);
+    addWallForce(outsideEnv, vel, aVel, r, _objs.mass[i], force, torque);
+    _objs.force.set(i, force);
+    _objs.torque.set(i, torque);
+    PROFILE_LAP(timer, Phase::Integrate);
+  }
+}
+
+template <typename I>
+void Environment::advanceStage(int stage, int begin, int end) {
+  PROFILE_LAP_TIMER(timer);
+  StageScratch unused;
+  // move unselected, awake objects
+  for (int i = begin; i < end; ++i) {
+    if (_objs.selected[i] || _objs.sleeping[i]) {
+      _objs.force.set(i, Vec3R());
+      _objs.torque.set(i, Vec3R());
+      continue;
+    }
+    BallState s = gatherState(i);
+    I::advance(stage, Real(_stepDt), s, I::STAGES > 1 ? _scratch[i] : unused);
+    if (stage == I::STAGES - 1) {
+      updateSleep(i, s);
+    }
+    // zero out net force and torque
+    s.force = s.torque = Vec3R();
+    scatterState(i, s);
+  }
+  PROFILE_LAP(timer, Phase::Integrate);
+}
+
+void Environment::buildGravityTree() {
+  if (simParams.environment_mutualGravity) {
+    PROFILE_SCOPE(Phase::Gravity);
+    _gravityTree.build(_objs.pos, _objs.mass);
+  }
+}
+
+void Environment::addMutualGravity(int begin, int end) {
+  if (!simParams.environment_mutualGravity) {
+    return;
+  }
+  double g = simParams.environment_gravityConstant;
+  double theta = simParams.environment_openingAngle;
+  double eps =
+      simParams.environment_softening * simParams.environment_unitsPerMeter;
+  for (int i = begin; i < end; ++i) {
+    if (_objs.selected[i] || _objs.sleeping[i]) {
+      continue;
+    }
+    Vec3 accel = simParams.environment_gravityDirect
+                     ? _gravityTree.directAccel(i, eps)
+                     : _gravityTree.accel(i, theta, eps);
+    _objs.force.add(i, accel * (g * _objs.mass[i]));
+  }
+}
+
+void Environment::updateSleep(int i, BallState &s) {
+  if (simParams.tuning_sleepTime <= 0) {
+    return;
+  }
+  Real sleepSpeed =
+      simParams.tuning_sleepSpeed * simParams.environment_unitsPerMeter;
+  // with mutual gravity, slow balls drifting free are still being pulled;
+  // only balls resting on something may sleep
+  bool resting = !simParams.environment_mutualGravity || _penetration[i] > 0;
+  if (resting && s.vel.mag() < sleepSpeed &&
+      s.aVel.mag() < simParams.tuning_sleepSpin) {
+    _objs.idleTime[i] += _stepDt;
+    if (_objs.idleTime[i] >= simParams.tuning_sleepTime) {
+      _objs.sleeping[i] = true;
+      s.vel = s.aVel = s.accel = s.aAccel = Vec3R();
+    }
+  } else {
+    _objs.idleTime[i] = 0;
+  }
+}
+
+void Environment::stepImpulses() {
+  // the stage 0 wake pass; symplectic Euler moves nothing in begin()
+  forSlots([this](int begin, int end) {
+    beginStage<SymplecticEuler>(0, begin, end);
+  });
+  _penetration.assign(_objs.size(), 0);
+  _forceEvals += _objs.size();
+  buildGravityTree();
+  forSlots([this](int begin, int end) { kickObjs(begin, end); });
+  {
+    PROFILE_SCOPE(Phase::Collide);
+    buildBroadphase();
+    _impulses.reset(chunks());
+    forChunks([this](int begin, int end, int chunk) {
+      gatherContacts(begin, end, chunk);
+    });
+  }
+  {
+    PROFILE_SCOPE(Phase::Solve);
+    _impulses.solve(_objs, Real(_stepDt));
+  }
+  forSlots([this](int begin, int end) { driftObjs(begin, end); });
+}
+
+void Environment::kickObjs(int begin, int end) {
+  PROFILE_LAP_TIMER(timer);
+  addBodyForces(_objs, begin, end, _g, _wind, _airDensity);
+  PROFILE_LAP(timer, Phase::BodyForces);
+  addMutualGravity(begin, end);
+  PROFILE_LAP(timer, Phase::Gravity);
+  Real dt = Real(_stepDt);
+  for (int i = begin; i < end; ++i) {
+    if (!_objs.selected[i] && !_objs.sleeping[i]) {
+      BallState s = gatherState(i);
+      updateAccel(s);
+      s.vel += s.accel * dt;
+      s.aVel += s.aAccel * dt;
+      scatterState(i, s);
+    }
+    _objs.force.set(i, Vec3R());
+    _objs.torque.set(i, Vec3R());
+  }
+  PROFILE_LAP(timer, Phase::Integrate);
+}
+
+void Environment::gatherContacts(int begin, int end, int chunk) {
+  auto movable = [this](int i) {
+    return !_objs.selected[i] && !_objs.sleeping[i];
+  };
+  for (int i = begin; i < end; ++i) {
+    Vec3R pos = _objs.pos.get(i);
+    Real r = _objs.radius[i];
+    auto visit = [&](int j) {
+      if (i == j) {
+        return;
+      }
+      Vec3R offset = _objs.pos.get(j) - pos;
+      Real dist = offset.mag();
+      Real depth = r + _objs.radius[j] - dist;
+      if (depth <= 0 || dist == 0) {
+        return;
+      }
+      // each side of a pair sees it, so a ball only wakes itself and only
+      // records its own overlap
+      if (_objs.sleeping[i] && !_objs.sleeping[j] && _objs.idleTime[j] == 0) {
+        _objs.wakeUp[i] = true;
+      }
+      _penetration[i] = std::max(_penetration[i], depth);
+      if (i < j && (movable(i) || movable(j))) {
+        _impulses.addBallContact(chunk, i, j, offset / dist, depth);
+      }
+    };
+    forEachCandidate(i, visit);
+    if (movable(i)) {
+      _bounds.forEachContact(
+          Vec3(pos), r, [&](const BoundaryTri &tri, double distToPlane) {
+            Real depth = r - distToPlane;
+            _penetration[i] = std::max(_penetration[i], depth);
+            _impulses.addWallContact(chunk, i, Vec3R(-tri.n), depth);
+          });
+    }
+  }
+}
+
+void Environment::driftObjs(int begin, int end) {
+  PROFILE_LAP_TIMER(timer);
+  Real dt = Real(_stepDt);
+  for (int i = begin; i < end; ++i) {
+    if (_objs.selected[i] || _objs.sleeping[i]) {
+      continue;
+    }
+    BallState s = gatherState(i);
+    s.pos += s.vel * dt;
+    rotateBy(s.rot, s.aVel, dt);
+    updateSleep(i, s);
+    scatterState(i, s);
+  }
+  PROFILE_LAP(timer, Phase::Integrate);
+}
+
+template <typename F>
+void Environment::forEachContact(int i, double skin, F f) const {
+  auto visit = [&](int j) {
+    if (j != i && (_objs.pos.get(j) - _objs.pos.get(i)).mag() <
+                      (1 + skin) * (_objs.radius[i] + _objs.radius[j])) {
+      f(j);
+    }
+  };
+  forEachCandidate(i, visit);
+}
+
+void Environment::stepBlocks() {
+  int levels = std::clamp(simParams.environment_blockLevels, 0, 30);
+  long ticks = 1L << levels; // shortest steps in the interval
+  double tick = _dt / ticks;
+  int n = _objs.size();
+  // balls don't sleep here, so nothing needs to watch for wake-ups
+  _objs.wakeAll();
+  _penetration.resize(n, 0);
+  _blockStart.assign(n, 0);
+  _blockEnd.assign(n, 0);
+  auto movable = [this](int i) { return !_objs.selected[i]; };
+  auto halfKick = [this](int i, double dt) {
+    _objs.vel.add(i, _objs.accel.get(i) * Real(0.5 * dt));
+    _objs.aVel.add(i, _objs.aAccel.get(i) * Real(0.5 * dt));
+  };
+  // levels may deepen at any tick, but only rise where the longer step
+  // would start; every step of the interval then ends by its last tick
+  auto startStep = [&](int i, long now) {
+    int level = std::clamp(std::ceil(std::log2(_dt / ballStep(i))), 0.0,
+                           double(levels));
+    while (now % (ticks >> level) != 0) {
+      level++;
+    }
+    _blockStart[i] = now;
+    _blockEnd[i] = now + (ticks >> level);
+    halfKick(i, (_blockEnd[i] - now) * tick);
+  };
+  _active.clear();
+  for (int i = 0; i < n; ++i) {
+    if (movable(i)) {
+      _active.push_back(i);
+    }
+  }
+  {
+    PROFILE_SCOPE(Phase::Collide);
+    buildBroadphase(simParams.environment_stepCourant); // for ballStep()
+  }
+  forActive([&](int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      startStep(i, 0);
+    }
+  });
+  std::vector<int> touched;
+  long now = 0;
+  while (now < ticks && !_active.empty()) {
+    long next = ticks;
+    for (int i = 0; i < n; ++i) {
+      if (movable(i)) {
+        next = std::min(next, _blockEnd[i]);
+      }
+    }
+    _stepDt = (next - now) * tick;
+    forSlots([this, &movable](int begin, int end) {
+      PROFILE_LAP_TIMER(timer);
+      Real dt = Real(_stepDt);
+      for (int i = begin; i < end; ++i) {
+        if (movable(i)) {
+          _objs.pos.add(i, _objs.vel.get(i) * dt);
+          rotateBy(_objs.rot[i], _objs.aVel.get(i), dt);
         }
       }
+      PROFILE_LAP(timer, Phase::Integrate);
+    });
+    now = next;
+    _active.clear();
+    for (int i = 0; i < n; ++i) {
+      if (movable(i) && _blockEnd[i] == now) {
+        _active.push_back(i);
+      }
     }
+    {
+      PROFILE_SCOPE(Phase::Collide);
+      buildBroadphase(simParams.environment_stepCourant);
+    }
+    buildGravityTree();
+    computeActiveForces();
+    // a contact only pushes the balls ending their step, so a ball touching
+    // or about to touch one of them ends its own step here too: its opening
+    // kick is cut back to the time it actually ran, it gets its forces now,
+    // and ballStep() then keeps it on contact steps
+    touched.clear();
+    for (int i : _active) {
+      forEachContact(i, simParams.environment_stepCourant, [&](int j) {
+        if (movable(j) && _blockEnd[j] != now) {
+          halfKick(j, (now - _blockEnd[j]) * tick);
+          _blockEnd[j] = now;
+          touched.push_back(j);
+        }
+      });
+    }
+    if (!touched.empty()) {
+      std::sort(touched.begin(), touched.end());
+      _active.swap(touched);
+      computeActiveForces();
+      _active.insert(_active.end(), touched.begin(), touched.end());
+      std::sort(_active.begin(), _active.end());
+    }
+    forActive([&](int begin, int end) {
+      PROFILE_LAP_TIMER(timer);
+      StageScratch unused;
+      for (int i = begin; i < end; ++i) {
+        BallState s = gatherState(i);
+        VelocityVerlet::advance(0, Real((now - _blockStart[i]) * tick), s,
+                                unused);
+        s.force = s.torque = Vec3R();
+        scatterState(i, s);
+        if (now < ticks) {
+          startStep(i, now);
+        }
+      }
+      PROFILE_LAP(timer, Phase::Integrate);
+    });
+    PROFILE_END_STEP();
+    _steps++;
+  }
+}
+
+double Environment::ballStep(int i) const {
+  double dt = simParams.environment_maxStep;
+  double v = Vec3R(_objs.vel.get(i)).mag();
+  if (v > 0) {
+    dt = std::min(dt, simParams.environment_stepCourant * _objs.radius[i] / v);
+  }
+  // a ball that may touch something within a step of the Courant limit
+  // takes contact steps already, or its first contact force would be
+  // applied over a whole long step
+  double skin = simParams.environment_stepCourant;
+  bool near = _penetration[i] > 0 ||
+              _bounds.contactOffset(_objs.pos.get(i),
+                                    (1 + skin) * _objs.radius[i])
+                      .mag() > 0;
+  if (!near) {
+    forEachContact(i, skin, [&](int j) { near = true; });
+  }
+  if (near) {
+    dt = std::min(dt, simParams.environment_stepStiffness *
+                          std::sqrt(_objs.mass[i] /
+                                    simParams.tuning_objSpringCoeff));
   }
-  // move unselected objects
-  for (auto &obj : _objs) {
-    if (obj.second.selected()) {
-      obj.second.setNetForce(Vec3());
-      obj.second.setNetTorque(Vec3());
+  // with mutual gravity, close passes need steps short enough that a ball
+  // moves well within the softening length before its pull changes
+  double a = Vec3R(_objs.accel.get(i)).mag();
+  if (simParams.environment_mutualGravity && a > 0) {
+    double eps =
+        simParams.environment_softening * simParams.environment_unitsPerMeter;
+    dt = std::min(dt, simParams.environment_blockAccuracy * std::sqrt(eps / a));
+  }
+  return dt;
+}
+
+void Environment::computeActiveForces() {
+  for (int i : _active) {
+    _penetration[i] = 0;
+  }
+  _forceEvals += _active.size();
+  {
+    PROFILE_SCOPE(Phase::Collide);
+    if (Broadphase(simParams.environment_broadphase) ==
+            Broadphase::BruteForce &&
+        !simParams.environment_neighborLists) {
+      forActive([this](int begin, int end) { collideBruteForce(begin, end); });
     } else {
-      Vec3 drag((_wind - obj.second.vel()).unit() * 0.5 * _airDensity *
-                pow((_wind - obj.second.vel()).mag(), 2) *
-                pow(obj.second.bbox().w() * 0.5, 2) * 0.5); // assume 0.5 C_d
-      obj.second.applyForce(
-          drag * simParams.environment_unitsPerMeter); // air resistance
-      obj.second.applyTorque(pow(obj.second.bbox().w() * 0.5, 2) *
-                             -obj.second.aVel() * _airDensity *
-                             simParams.environment_unitsPerMeter);
-      obj.second.applyForce(
-          obj.second.aVel().cross(obj.second.vel().unit() - _wind) *
-          _airDensity * simParams.environment_unitsPerMeter);
-      // record x and y offsets of object outside the environment
-      Vec3 outsideEnv = computeOutsideEnv(obj.second.bbox().pos(),
-                                      obj.second.bbox().w() * 0.5);
-      // std::cerr << outsideEnv << "\n";
-      obj.second.move(_dt, outsideEnv);
+      forActive([this](int begin, int end) { collideCandidates(begin, end); });
+    }
+  }
+  forActive([this](int begin, int end) { addBodyAndWallForces(begin, end); });
+}
+
+void Environment::forActive(const std::function<void(int, int)> &f) {
+  auto runs = [&](int begin, int end, int chunk) {
+    for (int k = begin; k < end;) {
+      int run = k + 1;
+      while (run < end && _active[run] == _active[run - 1] + 1) {
+        run++;
+      }
+      f(_active[k], _active[run - 1] + 1);
+      k = run;
+    }
+  };
+  if (_pool) {
+    _pool->parallelFor(_active.size(), runs);
+  } else {
+    runs(0, _active.size(), 0);
+  }
+}
+
+void Environment::post(Command cmd) {
+  std::lock_guard<std::mutex> lock(_commandMutex);
+  _commands.push_back(std::move(cmd));
+}
+
+void Environment::runCommands() {
+  std::vector<Command> commands;
+  {
+    std::lock_guard<std::mutex> lock(_commandMutex);
+    commands.swap(_commands);
+  }
+  for (Command &cmd : commands) {
+    cmd(*this);
+  }
+  // commands may edit, remove or add any ball, so predicted events,
+  // neighbor lists and sweep-and-prune pairs can't be trusted
+  if (!commands.empty()) {
+    _events.invalidate();
+    _neighbors.invalidate();
+    _sweep.invalidate();
+  }
+}
+
+void Environment::reorderObjs() {
+  PROFILE_SCOPE(Phase::Collide);
+  std::vector<int> order = mortonOrder(
+      _objs.pos,
+      2.0 * simParams.controls_radius[1] * simParams.environment_unitsPerMeter);
+  _objs.permute(order);
+  if (_penetration.size() == order.size()) {
+    std::vector<Real> penetration(order.size());
+    for (int k = 0; k < int(order.size()); ++k) {
+      penetration[k] = _penetration[order[k]];
+    }
+    _penetration.swap(penetration);
+  }
+  _sweep.permute(order);
+  _events.invalidate();
+  _neighbors.invalidate();
+  _reorderedAt = _steps;
+}
+
+void Environment::writeSnapshot(EnvSnapshot &s) const {
+  s.ids.resize(_objs.size());
+  for (int i = 0; i < _objs.size(); ++i) {
+    s.ids[i] = _objs.id(i);
+  }
+  s.pos = _objs.pos;
+  s.prevPos = _objs.prevPos;
+  s.rot = _objs.rot;
+  s.prevRot = _objs.prevRot;
+  s.radius = _objs.radius;
+}
+
+double Environment::chooseStep() {
+  double rMin = INFINITY, vMax = 0, mContact = INFINITY, depth = 0;
+  for (int i = 0; i < _objs.size(); ++i) {
+    if (_objs.selected[i] || _objs.sleeping[i]) {
+      continue;
     }
+    rMin = std::min<double>(rMin, _objs.radius[i]);
+    vMax = std::max<double>(vMax, Vec3R(_objs.vel.get(i)).mag());
+    if (i < int(_penetration.size()) && _penetration[i] > 0) {
+      mContact = std::min<double>(mContact, _objs.mass[i]);
+      depth = std::max<double>(depth, _penetration[i] / _objs.radius[i]);
+    }
+  }
+  double dt = simParams.environment_maxStep;
+  if (vMax > 0) {
+    dt = std::min(dt, simParams.environment_stepCourant * rMin / vMax);
   }
+  // impulse contacts have no stiffness to resolve
+  if (mContact < INFINITY &&
+      ContactModel(simParams.environment_contacts) == ContactModel::Penalty) {
+    dt = std::min(dt, simParams.environment_stepStiffness *
+                          std::sqrt(mContact / simParams.tuning_objSpringCoeff));
+  }
+  // back off quickly while overlaps are too deep, recover slowly
+  dt = std::min(dt, depth > simParams.environment_maxPenetration
+                        ? 0.5 * _adaptDt
+                        : 1.25 * _adaptDt);
+  _adaptDt = std::clamp(dt, simParams.environment_minStep,
+                        simParams.environment_maxStep);
+  return _adaptDt;
 }
 
 void Environment::update() {
+  runCommands();
   if (!_paused) {
-    moveObjs();
+    int interval = simParams.environment_reorderInterval;
+    if (interval > 0 && _steps - _reorderedAt >= interval) {
+      reorderObjs();
+    }
+    if (Engine(simParams.environment_engine) == Engine::EventDriven) {
+      _events.advance(_objs, _bounds, _g, _dt);
+      PROFILE_END_STEP();
+    } else if (simParams.environment_blockSteps &&
+               ContactModel(simParams.environment_contacts) ==
+                   ContactModel::Penalty) {
+      stepBlocks();
+    } else if (simParams.environment_adaptiveStep) {
+      // split what is left of the output interval evenly, so the last step
+      // lands exactly on the output time without a sliver step
+      double left = _dt;
+      while (left > 0) {
+        int n = std::ceil(left / chooseStep() - 1e-9);
+        _stepDt = n > 1 ? left / n : left;
+        moveObjs();
+        PROFILE_END_STEP();
+        _steps++;
+        left = n > 1 ? left - _stepDt : 0;
+      }
+    } else {
+      _stepDt = _dt;
+      moveObjs();
+      PROFILE_END_STEP();
+      _steps++;
+    }
   }
   _t++;
 }
 
 void Environment::print(std::ostream &out) const {
   out << "[t " << _t << "] env " << (_paused ? "paused" : "") << "\n";
-  if (_objs.size() > 0) {
-    for (auto &obj : _objs) {
-      out << " obj id " << obj.first << " " << obj.second << "\n";
-    }
+  for (int i = 0; i < _objs.size(); ++i) {
+    out << " obj id " << _objs.id(i) << " " << _objs.ball(i) << "\n";
   }
 }
 
+int Environment::sleepingObjs() const {
+  return std::count(_objs.sleeping.begin(), _objs.sleeping.end(), true);
+}
+
 double Environment::computeEnergy() const {
   double result = 0;
-  for (auto &obj : _objs) {
-    result += obj.second.kenergy() + obj.second.penergy();
+  for (int i = 0; i < _objs.size(); ++i) {
+    Ball obj = _objs.ball(i);
+    result += obj.kenergy() + obj.penergy();
+  }
+  if (simParams.environment_mutualGravity) {
+    // each pair's potential is counted from both ends, so halve the sum;
+    // velocities in kenergy() are in m/s, so scale distances to match
+    GravityTree tree;
+    tree.build(_objs.pos, _objs.mass);
+    double eps =
+        simParams.environment_softening * simParams.environment_unitsPerMeter;
+    double pairs = 0;
+    for (int i = 0; i < _objs.size(); ++i) {
+      pairs += _objs.mass[i] *
+               (simParams.environment_gravityDirect
+                    ? tree.directPotential(i, eps)
+                    : tree.potential(i, simParams.environment_openingAngle,
+                                     eps));
+    }
+    result += 0.5 * simParams.environment_gravityConstant * pairs /
+              std::pow(simParams.environment_unitsPerMeter, 2);
   }
   return result;
 }
 
-Vec3 Environment::computeOutsideEnv(Vec3 pos, double radius) const {
-  Vec3 result;
-  std::vector<float> meshData = _meshBounds->vertexData();
-  std::vector<Vec3> verts_v, normals_v;
-  for (int i = 0; i < meshData.size() / 8; ++i) {
-    verts_v.push_back(
-        Vec3(meshData[8 * i], meshData[8 * i + 1], meshData[8 * i + 2]));
-    normals_v.push_back(
-        Vec3(meshData[8 * i + 3], meshData[8 * i + 4], meshData[8 * i + 5]));
-  }
-  for (int i = 0; i < verts_v.size() / 3; ++i) {
-    double distToPlane = normals_v[3 * i].dot(Vec3(pos - verts_v[3 * i]));
-    if (distToPlane < radius) {
-      Vec3 pointOnPlane = pos - (normals_v[3 * i] * distToPlane);
-      double abCheck = ((verts_v[3 * i + 1] - verts_v[3 * i])
-                            .cross(pointOnPlane - verts_v[3 * i]))
-                           .dot(normals_v[3 * i]);
-
-      if (((verts_v[3 * i + 1] - verts_v[3 * i])
-               .cross(pointOnPlane - verts_v[3 * i]))
-                  .dot(normals_v[3 * i]) > 0 &&
-          ((verts_v[3 * i + 2] - verts_v[3 * i + 1])
-               .cross(pointOnPlane - verts_v[3 * i + 1]))
-                  .dot(normals_v[3 * i]) > 0 &&
-          ((verts_v[3 * i] - verts_v[3 * i + 2])
-               .cross(pointOnPlane - verts_v[3 * i + 2]))
-                  .dot(normals_v[3 * i]) > 0) {
-        result += normals_v[3 * i] * (distToPlane - radius);
-      }
+bool Environment::save(const std::string &fileName) const {
+  std::ofstream file(fileName, std::ios::binary);
+  file.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  writeValue(file, SNAPSHOT_VERSION);
+  writeValue(file, uint8_t(sizeof(Real)));
+  writeValue(file, _dt);
+  writeValue(file, int32_t(_t));
+  writeValue(file, int32_t(_nextObjId));
+  writeValue(file, uint8_t(_paused));
+  writeValue(file, int32_t(_objs.size()));
+  _objs.write(file);
+  if (!file) {
+    std::cerr << "warning: could not save snapshot \"" << fileName << "\"\n";
+    return false;
+  }
+  std::cerr << "env save " << _objs.size() << " objs to " << fileName << "\n";
+  return true;
+}
+
+bool Environment::load(const std::string &fileName) {
+  std::ifstream file(fileName, std::ios::binary);
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  uint32_t version;
+  double dt;
+  int32_t t, nextObjId, count;
+  uint8_t realSize, paused;
+  if (!file.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 ||
+      !readValue(file, version)) {
+    std::cerr << "warning: \"" << fileName << "\" is not a snapshot\n";
+    return false;
+  }
+  if (version != SNAPSHOT_VERSION) {
+    std::cerr << "warning: snapshot \"" << fileName << "\" has version "
+              << version << ", expected " << SNAPSHOT_VERSION << "\n";
+    return false;
+  }
+  if (!readValue(file, realSize) || realSize != sizeof(Real)) {
+    std::cerr << "warning: snapshot \"" << fileName
+              << "\" was saved with a different precision build\n";
+    return false;
+  }
+  BallStore objs;
+  if (!(readValue(file, dt) && readValue(file, t) &&
+        readValue(file, nextObjId) && readValue(file, paused) &&
+        readValue(file, count)) ||
+      count < 0 || !objs.read(file, count)) {
+    std::cerr << "warning: snapshot \"" << fileName << "\" is truncated\n";
+    return false;
+  }
+  // the broadphase cell size assumes every radius is at most controls_radius
+  // max, as loadScene enforces for scene files
+  const Real maxRadius =
+      simParams.controls_radius[1] * simParams.environment_unitsPerMeter;
+  for (int i = 0; i < objs.size(); ++i) {
+    if (!(objs.radius[i] > 0 && objs.radius[i] <= maxRadius)) {
+      std::cerr << "warning: snapshot \"" << fileName << "\" has radius "
+                << objs.radius[i] << " outside (0, " << maxRadius << "]\n";
+      return false;
     }
   }
-  return result;
-}
\ No newline at end of file
+  if (dt != _dt) {
+    std::cerr << "warning: snapshot time step " << dt
+              << " differs from environment time step " << _dt << "\n";
+  }
+  _objs = std::move(objs);
+  _events.invalidate();
+  _neighbors.invalidate();
+  _sweep.invalidate();
+  _t = t;
+  _adaptDt = simParams.environment_minStep; // not saved; restart cautiously
+  _nextObjId = nextObjId;
+  _paused = paused;
+  std::cerr << "env load " << _objs.size() << " objs from " << fileName
+            << " at t " << _t << "\n";
+  return true;
+}
+
+Vec3 Environment::computeOutsideEnv(Vec3 pos, double radius) const {
+  return _bounds.outsideOffset(pos, radius);
+}
@@ -3,19 +3,50 @@
 #ifndef ENV3D_H
 #define ENV3D_H
 
+#include <atomic>
 #include <cmath>
-#include <map>
-#include <mb-libs/renderObject.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "ball.h"
+#include "ballStore.h"
+#include "boundary.h"
+#include "envSnapshot.h"
+#include "eventEngine.h"
+#include "forceKernels.h"
+#include "gravityTree.h"
+#include "impulseSolver.h"
+#include "neighborList.h"
+#include "integrators.h"
+#include "morton.h"
 #include "simParams.h"
+#include "sweepPrune.h"
+#include "threadPool.h"
+#include "uniformGrid.h"
 #include "vec3d.h"
 
 extern SimParameters simParams;
 
 // each object has a unique ID (allows per-object colors
-// if visualization is used)
-typedef std::map<int, Ball> EnvObjSet;
+// if visualization is used); state is stored per field, see ballStore.h
+typedef BallStore EnvObjSet;
+
+// how collision candidates are found (environment_broadphase)
+enum class Broadphase { BruteForce = 0, UniformGrid = 1, SweepAndPrune = 2 };
+
+// how the environment advances (environment_engine)
+enum class Engine {
+  Stepped = 0,    // fixed or adaptive time steps
+  EventDriven = 1 // from collision to collision, see eventEngine.h
+};
+
+// how touching balls push apart (environment_contacts)
+enum class ContactModel {
+  Penalty = 0, // springs, integrated with environment_integrator
+  Impulse = 1  // velocity impulses from ImpulseSolver, with symplectic Euler
+};
 
 class Environment {
 public:
@@ -31,18 +62,37 @@ public:
   const Vec3 &wind() const { return _wind; };
   const double &airDensity() const { return _airDensity; };
   EnvObjSet &objs() { return _objs; };
-  int time() const { return _t; };
+  int time() const { return _t; }; // outputs (update() calls) so far
+  long steps() const { return _steps; }; // integration steps so far
+  double stepDt() const { return _stepDt; }; // size of the last step
+  long events() const { return _events.events(); }; // event-driven engine
+  long forceEvals() const { return _forceEvals; }; // per ball, so far
+  // with environment_neighborLists, their rebuild count and mean length
+  const NeighborList &neighbors() const { return _neighbors; };
+  int sleepingObjs() const; // balls currently asleep
 
   // setters
-  void setWind(Vec3 w) { _wind = w; };
+  void setWind(Vec3 w) {
+    _wind = w;
+    _objs.wakeAll();
+  };
   void setAirDensity(double d) { _airDensity = d; };
-  void setBounds(GraphicsTools::RenderObject *r) { _meshBounds = r; };
+  // boundary collision geometry, built once from the boundary mesh
+  void setBounds(const BoundaryCollider &b) { _bounds = b; };
+  const BoundaryCollider &bounds() const { return _bounds; };
 
   // object operations
-  void addObj(const Ball &obj) { _objs[_nextObjId++] = obj; };
+  void addObj(const Ball &obj) { _objs.add(_nextObjId++, obj); };
+  void addObj(int id, const Ball &obj) { _objs.add(id, obj); };
+  // take the next ID now, for a ball added later with addObj(id, obj)
+  int reserveObjId() { return _nextObjId++; };
   void clearObjs() { _objs.clear(); };
   int lastObjId() const { return _nextObjId - 1; };
-  void removeObj(int id) { _objs.erase(id); };
+  // wakes everything, since sleeping balls may have rested on this one
+  void removeObj(int id) {
+    _objs.remove(id);
+    _objs.wakeAll();
+  };
   void setNextId(int id) {
     _nextObjId = id;
   }; // to handle issues with non-ball renderobject deletion
@@ -50,8 +100,31 @@ public:
   // simulation operations
   void moveObjs();
   void togglePause() { _paused = _paused ? false : true; };
-  void update(); // move objects and increment time (scale
-                 // factor to account for frame rates)
+  // advance to the next output time, dt() later: one step of dt, with
+  // environment_adaptiveStep as many sized steps as the scene needs, with
+  // environment_blockSteps a power-of-two share of it per ball, or with the
+  // event-driven engine every collision on the way
+  void update();
+  // remember current positions and rotations as the interpolation start
+  // for rendering; call before the last step of a frame
+  void storePrevState() {
+    _objs.prevPos = _objs.pos;
+    _objs.prevRot = _objs.rot;
+  };
+
+  // deferred edits, safe to post from any thread; run in order at the start
+  // of the next update(), on the stepping thread
+  typedef std::function<void(Environment &)> Command;
+  void post(Command cmd);
+  // copy ball state (including the interpolation start) for rendering
+  void writeSnapshot(EnvSnapshot &s) const;
+
+  // checkpoint all ball state, the step count and the next object ID to a
+  // binary file, or restore one; both warn and return false on failure,
+  // and a failed load leaves the environment unchanged. load rejects
+  // checkpoints with a radius outside (0, controls_radius max]
+  bool save(const std::string &fileName) const;
+  bool load(const std::string &fileName);
 
   // debug
   void print(std::ostream &out) const;
@@ -62,15 +135,164 @@ public:
   Vec3 computeOutsideEnv(Vec3 pos, double radius) const;
 
 private:
-  GraphicsTools::RenderObject *_meshBounds; // mesh boundary
-  double _dt;                               // time step
-  Vec3 _g;                                  // gravity vector
+  // collision passes, over every pair or the broadphase candidates; both
+  // resolve each ordered pair of slots once. a pair only writes the force
+  // on its first ball, so splitting by first slot is race free and gives
+  // the same sums for any thread count
+  void collideBruteForce(int begin, int end);
+  void collideCandidates(int begin, int end);
+  // bring the grid or sweep-and-prune lists up to date with the current
+  // positions; candidates then include balls up to skin times their radii
+  // apart. with neighbor lists, only when they are stale, and the lists
+  // are rebuilt from the result
+  void buildBroadphase(double skin = 0);
+  // call f(j) for every ball j that may touch ball i (i itself may be
+  // included), from the last buildBroadphase()
+  template <typename F> void forEachCandidate(int i, F f) const {
+    if (simParams.environment_neighborLists) {
+      _neighbors.forEachNear(i, f);
+    } else {
+      forEachIndexed(i, f);
+    }
+  };
+  // same, straight from the grid or sweep-and-prune lists; every ball with
+  // brute force
+  template <typename F> void forEachIndexed(int i, F f) const {
+    switch (Broadphase(simParams.environment_broadphase)) {
+    case Broadphase::UniformGrid:
+      _grid.forEachNear(i, f);
+      break;
+    case Broadphase::SweepAndPrune:
+      _sweep.forEachNear(i, f);
+      break;
+    default:
+      for (int j = 0; j < _objs.size(); ++j) {
+        f(j);
+      }
+      break;
+    }
+  };
+  // queue the contact of the ball in slot i with the ball in slot j if they
+  // overlap; full batches are resolved right away. a sleeping ball i only
+  // reacts to, and is woken by, a ball j that is moving
+  void resolvePair(int i, int j, ContactBatch &batch);
+  // one step with an integration scheme from integrators.h
+  template <typename I> void stepObjs();
+  // wake flagged balls (first stage only) and let the scheme move each
+  // ball to where this stage's forces are evaluated
+  template <typename I> void beginStage(int stage, int begin, int end);
+  // contact, body and wall forces on every ball in its current state
+  void computeForces();
+  void addBodyAndWallForces(int begin, int end);
+  // environment_mutualGravity: rebuild the tree from the current positions,
+  // then add each ball's pull towards the others
+  void buildGravityTree();
+  void addMutualGravity(int begin, int end);
+  // environment_blockSteps: advance one output interval with each ball on
+  // its own power-of-two fraction of it. all balls drift together to the
+  // next time any ball's step ends; only those balls get new forces, a
+  // closing half kick, a new step size and an opening half kick
+  void stepBlocks();
+  // preferred step of ball i, from its own velocity, acceleration and
+  // nearness to other balls and walls; needs a current grid
+  double ballStep(int i) const;
+  // forces on the balls in _active only, with everything else where it is;
+  // the grid and gravity tree must be current
+  void computeActiveForces();
+  // call f(j) for each ball j closer to ball i than (1 + skin) times their
+  // radii, using the current grid
+  template <typename F> void forEachContact(int i, double skin, F f) const;
+  // run f(begin, end) over the runs of consecutive slots in _active, split
+  // across the worker pool
+  void forActive(const std::function<void(int, int)> &f);
+  // turn each ball's force into motion; sleep bookkeeping after the last
+  // stage
+  template <typename I> void advanceStage(int stage, int begin, int end);
+  // count how long ball i has been slow and put it to sleep after
+  // tuning_sleepTime
+  void updateSleep(int i, BallState &s);
+  // one step with impulse contacts: kick every ball with its non-contact
+  // forces, solve the contacts for the new velocities, then drift
+  void stepImpulses();
+  void kickObjs(int begin, int end);
+  // queue the contacts of the balls in [begin, end) with the solver, each
+  // ball pair once
+  void gatherContacts(int begin, int end, int chunk);
+  void driftObjs(int begin, int end);
+  // continuous collision detection (environment_ccd): sweep each ball that
+  // moved more than environment_ccdMotion of its radius this step from its
+  // start to its end position. at the first ball or wall hit the ball
+  // stops, bounces, and moves on at its new velocity for the rest of the
+  // step, so fast balls can't pass through others or through thin walls;
+  // a ball it hits does the same against the walls
+  void sweepFastMovers();
+  // fraction of the way from `from` to `to`, the rest of ball i's step
+  // after `done` of it, at which i first touches another ball, or INFINITY;
+  // sets hit to the other ball's slot. other balls move in a straight line
+  // from their start to their end position
+  double sweepBalls(int i, const Vec3 &from, const Vec3 &to, double done,
+                    int &hit) const;
+  // move ball j, pushed at `from` after `done` of the step, on at its
+  // velocity for the rest of the step, bouncing off walls on the way
+  void carrySwept(int j, Vec3 from, double done);
+  // position of ball j after `done` of the step, on that line
+  Vec3 sweptPos(int j, double done) const;
+  // restitution impulse of a swept hit of ball i on ball j (-1 for a
+  // wall), n the unit normal from i towards what it hit
+  void bounceSwept(int i, int j, const Vec3 &n);
+  // preferred size of the next adaptive step, from the current velocities
+  // and the overlaps found by the last force evaluation
+  double chooseStep();
+  BallState gatherState(int i) const;
+  void scatterState(int i, const BallState &s);
+  // run f(begin, end) over all slots, split across the worker pool
+  void forSlots(const std::function<void(int, int)> &f);
+  // same, also passing the chunk index; chunks() is the number of chunks
+  void forChunks(const std::function<void(int, int, int)> &f);
+  int chunks() const { return _pool ? _pool->size() : 1; };
+  void runCommands();
+  // sort the ball slots along a Morton curve of the positions, with cells
+  // as wide as the largest ball, so contact partners sit close in memory
+  // (environment_reorderInterval); per-slot state follows the balls
+  void reorderObjs();
+
+  BoundaryCollider _bounds; // mesh boundary
+  double _dt;               // time step, or output interval if adaptive
+  double _stepDt;           // size of the current step
+  double _adaptDt;          // preferred adaptive step, before output clamping
+  Vec3 _g;                  // gravity vector
   Vec3 _wind;
   double _airDensity;
-  int _nextObjId;
+  std::atomic<int> _nextObjId;
   EnvObjSet _objs; // set of objects
   bool _paused;    // run state (running or paused)
   int _t;          // simulation time
+  long _steps;     // integration steps
+  long _reorderedAt; // _steps at the last reorderObjs()
+
+  UniformGrid _grid; // broadphase, rebuilt every step
+  SweepAndPrune _sweep; // broadphase, updated every step
+  NeighborList _neighbors; // contact candidates, rebuilt when stale
+  std::vector<StageScratch> _scratch; // per slot, for multi-stage schemes
+  std::vector<Real> _penetration; // per slot, deepest overlap last evaluated
+  ImpulseSolver _impulses; // contacts of the current impulse step
+  Vec3Array _stepStart;    // positions at the start of the step, for ccd
+  // ccd candidates: end positions of the balls that moved at most a grid
+  // cell, and the balls that moved further or were pushed, tested apart
+  UniformGrid _ccdGrid;
+  std::vector<int> _ccdMovers;
+  std::vector<unsigned char> _ccdMover; // per slot, in _ccdMovers
+  double _ccdReach; // grid balls are this close to their end position
+  EventEngine _events;     // predictions, kept while no commands run
+  GravityTree _gravityTree; // rebuilt every force evaluation
+  long _forceEvals;         // balls whose forces were evaluated
+  std::vector<int> _active;     // block steps: slots ending a step now
+  std::vector<long> _blockStart; // per slot, tick the step started at
+  std::vector<long> _blockEnd;   // and the tick it ends at
+  std::unique_ptr<ThreadPool> _pool; // null when stepping on one thread
+
+  std::mutex _commandMutex;
+  std::vector<Command> _commands; // posted, not yet run
 };
 
 // print compatibility with cout/cerr
@@ -0,0 +1,65 @@
+/* Read-only copies of the environment's ball state for the render thread,
+    passed from the stepping thread through a lock-free triple buffer. */
+
+#ifndef ENV_SNAPSHOT_H
+#define ENV_SNAPSHOT_H
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "quaternion.h"
+#include "vec3d.h"
+
+struct EnvSnapshot {
+  int size() const { return ids.size(); };
+  // slot holding a ball ID, -1 if absent; linear, meant for one-off lookups
+  int find(int id) const {
+    auto it = std::find(ids.begin(), ids.end(), id);
+    return it == ids.end() ? -1 : it - ids.begin();
+  };
+
+  std::vector<int> ids; // ball ID per slot
+  Vec3Array pos;
+  Vec3Array prevPos; // before the last step, for render interpolation
+  std::vector<QuaternionR> rot;
+  std::vector<QuaternionR> prevRot;
+  std::vector<Real> radius;
+  double tStep = 0; // wall time (ms) the last step finished
+};
+
+// one writer thread fills back() and publishes it; one reader thread
+// acquires the newest published snapshot. neither side ever waits, and the
+// reader's front() is never written while it holds it
+class SnapshotBuffer {
+public:
+  SnapshotBuffer() : _back(0), _middle(1), _front(2) {};
+
+  // writer side
+  EnvSnapshot &back() { return _bufs[_back]; };
+  void publish() {
+    _back = _middle.exchange(_back | FRESH, std::memory_order_acq_rel) & INDEX;
+  };
+
+  // reader side; returns false if nothing new was published since the last
+  // call, in which case front() is unchanged
+  bool acquire() {
+    if (!(_middle.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+    _front = _middle.exchange(_front, std::memory_order_acq_rel) & INDEX;
+    return true;
+  };
+  const EnvSnapshot &front() const { return _bufs[_front]; };
+
+private:
+  static const int INDEX = 3;
+  static const int FRESH = 4; // set on _middle when it holds a new snapshot
+
+  EnvSnapshot _bufs[3];
+  int _back;
+  std::atomic<int> _middle;
+  int _front;
+};
+
+#endif
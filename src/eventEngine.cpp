@@ -0,0 +1,394 @@
+#include "eventEngine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+#include "integrators.h"
+#include "simParams.h"
+
+// global simulation parameters (from XML config file)
+extern SimParameters simParams;
+
+// cells per axis at most; larger scenes get larger cells
+static const int MAX_DIMS = 64;
+// events per ball in one advance() before giving up on the interval
+static const long MAX_EVENTS_PER_BALL = 10000;
+
+static double component(const Vec3 &v, int axis) {
+  return axis == 0 ? v.x() : axis == 1 ? v.y() : v.z();
+}
+
+// earliest t >= 0 at which c0 + c1 t + c2 t^2 crosses zero upwards
+// (rising) or downwards, or INFINITY
+static double earliestCrossing(double c0, double c1, double c2, bool rising) {
+  double roots[2];
+  int n = 0;
+  if (c2 == 0) {
+    if (c1 != 0) {
+      roots[n++] = -c0 / c1;
+    }
+  } else {
+    double disc = c1 * c1 - 4 * c2 * c0;
+    if (disc < 0) {
+      return INFINITY;
+    }
+    // the two roots without cancellation
+    double q = -0.5 * (c1 + std::copysign(std::sqrt(disc), c1));
+    roots[n++] = q / c2;
+    if (q != 0) {
+      roots[n++] = c0 / q;
+    }
+    if (n == 2 && roots[1] < roots[0]) {
+      std::swap(roots[0], roots[1]);
+    }
+  }
+  for (int k = 0; k < n; ++k) {
+    double slope = c1 + 2 * c2 * roots[k];
+    if (roots[k] >= 0 && (rising ? slope > 0 : slope < 0)) {
+      return roots[k];
+    }
+  }
+  return INFINITY;
+}
+
+void EventEngine::advance(BallStore &objs, const BoundaryCollider &bounds,
+                          const Vec3 &gravity, double dt) {
+  if (!_valid || _objs != &objs || objs.size() != int(_time.size())) {
+    _objs = &objs;
+    _bounds = &bounds;
+    _g = gravity;
+    init();
+  }
+  double end = _now + dt;
+  long limit = _events + MAX_EVENTS_PER_BALL * std::max(objs.size(), 1);
+  while (!_queue.empty() && _queue.top().t <= end) {
+    Event e = _queue.top();
+    _queue.pop();
+    if (e.countA != _count[e.a] ||
+        (e.type == EventType::Ball && e.countB != _count[e.b])) {
+      continue; // a ball has changed course since this was predicted
+    }
+    _now = e.t;
+    switch (e.type) {
+    case EventType::Ball:
+      collideBalls(e.a, e.b);
+      break;
+    case EventType::Wall:
+      collideWall(e.a, e.b);
+      break;
+    case EventType::Cell:
+      changeCell(e.a, e.b);
+      break;
+    }
+    if (++_events > limit) {
+      std::cerr << "warning: more than " << MAX_EVENTS_PER_BALL
+                << " events per ball in one interval; skipping the rest\n";
+      invalidate();
+      break;
+    }
+  }
+  _now = end;
+  for (int i = 0; i < objs.size(); ++i) {
+    moveTo(i, end);
+  }
+}
+
+void EventEngine::init() {
+  BallStore &objs = *_objs;
+  int n = objs.size();
+  objs.wakeAll();
+  _time.assign(n, _now);
+  _count.assign(n, 0);
+  _coord.resize(n);
+
+  // grid over the boundary mesh, or over the balls if there is none
+  double maxR = 0;
+  for (int i = 0; i < n; ++i) {
+    maxR = std::max<double>(maxR, objs.radius[i]);
+  }
+  for (int k = 0; k < 3; ++k) {
+    _lo[k] = INFINITY;
+    _hi[k] = -INFINITY;
+  }
+  if (!_bounds->empty()) {
+    std::copy(_bounds->lo(), _bounds->lo() + 3, _lo);
+    std::copy(_bounds->hi(), _bounds->hi() + 3, _hi);
+  } else {
+    for (int i = 0; i < n; ++i) {
+      Vec3 p = objs.pos.get(i);
+      for (int k = 0; k < 3; ++k) {
+        if (std::isfinite(component(p, k))) {
+          _lo[k] = std::min(_lo[k], component(p, k));
+          _hi[k] = std::max(_hi[k], component(p, k));
+        }
+      }
+    }
+  }
+  // no balls, or only diverged ones: one cell at the origin. balls outside
+  // the bounds land in the outer cells, which reach to infinity
+  for (int k = 0; k < 3; ++k) {
+    if (!(std::isfinite(_lo[k]) && std::isfinite(_hi[k]) &&
+          _lo[k] <= _hi[k])) {
+      _lo[k] = _hi[k] = 0;
+    }
+  }
+  _cellSize = std::max(2 * maxR, 1e-9);
+  for (int k = 0; k < 3; ++k) {
+    _cellSize = std::max(_cellSize, (_hi[k] - _lo[k]) / MAX_DIMS);
+  }
+  assert(std::isfinite(_cellSize));
+  for (int k = 0; k < 3; ++k) {
+    _dims[k] = std::clamp(int(std::ceil((_hi[k] - _lo[k]) / _cellSize)), 1,
+                          MAX_DIMS);
+    assert(_dims[k] >= 1 && _dims[k] <= MAX_DIMS);
+  }
+  _cells.assign(_dims[0] * _dims[1] * _dims[2], {});
+  for (int i = 0; i < n; ++i) {
+    Vec3 p = objs.pos.get(i);
+    for (int k = 0; k < 3; ++k) {
+      // clamp before the cast; NaNs go to the first cell
+      double c = std::floor((component(p, k) - _lo[k]) / _cellSize);
+      _coord[i][k] = c > 0 ? int(std::min(c, double(_dims[k] - 1))) : 0;
+    }
+    _cells[cellIndex(_coord[i].data())].push_back(i);
+  }
+
+  _queue = {};
+  for (int i = 0; i < n; ++i) {
+    predict(i);
+  }
+  _valid = true;
+}
+
+double EventEngine::cellLo(int axis, int coord) const {
+  return coord == 0 ? -INFINITY : _lo[axis] + coord * _cellSize;
+}
+
+double EventEngine::cellHi(int axis, int coord) const {
+  return coord == _dims[axis] - 1 ? INFINITY
+                                  : _lo[axis] + (coord + 1) * _cellSize;
+}
+
+Vec3 EventEngine::posAt(int i, double t) const {
+  Vec3 pos = _objs->pos.get(i);
+  if (_objs->selected[i]) {
+    return pos;
+  }
+  double dt = t - _time[i];
+  return pos + Vec3(_objs->vel.get(i)) * dt + _g * (0.5 * dt * dt);
+}
+
+Vec3 EventEngine::velAt(int i, double t) const {
+  if (_objs->selected[i]) {
+    return Vec3();
+  }
+  return Vec3(_objs->vel.get(i)) + _g * (t - _time[i]);
+}
+
+void EventEngine::moveTo(int i, double t) {
+  if (!_objs->selected[i]) {
+    _objs->pos.set(i, posAt(i, t));
+    _objs->vel.set(i, velAt(i, t));
+    rotateBy(_objs->rot[i], _objs->aVel.get(i), Real(t - _time[i]));
+  }
+  _time[i] = t;
+}
+
+void EventEngine::forEachNeighbor(int i,
+                                  const std::function<void(int)> &f) const {
+  const std::array<int, 3> &c = _coord[i];
+  int n[3];
+  for (n[0] = std::max(c[0] - 1, 0); n[0] <= std::min(c[0] + 1, _dims[0] - 1);
+       ++n[0]) {
+    for (n[1] = std::max(c[1] - 1, 0);
+         n[1] <= std::min(c[1] + 1, _dims[1] - 1); ++n[1]) {
+      for (n[2] = std::max(c[2] - 1, 0);
+           n[2] <= std::min(c[2] + 1, _dims[2] - 1); ++n[2]) {
+        for (int j : _cells[cellIndex(n)]) {
+          if (j != i) {
+            f(j);
+          }
+        }
+      }
+    }
+  }
+}
+
+void EventEngine::predict(int i) {
+  if (_objs->selected[i]) {
+    return;
+  }
+  int crossing = 0, tri = 0;
+  double tCell = cellExit(i, crossing);
+  if (tCell < INFINITY) {
+    _queue.push({_now + tCell, EventType::Cell, i, crossing, _count[i], 0});
+  }
+  double tWall = wallHit(i, tCell, tri);
+  if (tWall < INFINITY) {
+    _queue.push({_now + tWall, EventType::Wall, i, tri, _count[i], 0});
+  }
+  // anything later is predicted again when ball i changes cell or bounces
+  double horizon = std::min(tCell, tWall);
+  forEachNeighbor(i, [&](int j) {
+    double t = predictPair(i, j, horizon);
+    if (t <= horizon) {
+      _queue.push({_now + t, EventType::Ball, i, j, _count[i], _count[j]});
+    }
+  });
+}
+
+double EventEngine::predictPair(int i, int j, double horizon) const {
+  Vec3 s = posAt(j, _now) - posAt(i, _now);
+  Vec3 d = velAt(j, _now) - velAt(i, _now);
+  double rsum = _objs->radius[i] + _objs->radius[j];
+  double sd = s.dot(d);
+  double c = s.dot(s) - rsum * rsum;
+  if (c <= 0) {
+    return sd < 0 ? 0 : INFINITY; // touching; collide if closing in
+  }
+  if (!_objs->selected[j]) {
+    // both fall alike, so they close in along a straight line
+    if (sd >= 0) {
+      return INFINITY;
+    }
+    double dd = d.dot(d);
+    double disc = sd * sd - dd * c;
+    return disc < 0 ? INFINITY : (-sd - std::sqrt(disc)) / dd;
+  }
+  // j is held while i falls; look for the first touch in steps through the
+  // horizon, then bisect
+  if (!(horizon < INFINITY)) {
+    return INFINITY;
+  }
+  auto gap = [&](double t) {
+    return (s + d * t - _g * (0.5 * t * t)).mag() - rsum;
+  };
+  const int SAMPLES = 16;
+  double t0 = 0;
+  for (int k = 1; k <= SAMPLES; ++k) {
+    double t1 = horizon * k / SAMPLES;
+    if (gap(t1) <= 0) {
+      for (int it = 0; it < 40; ++it) {
+        double mid = 0.5 * (t0 + t1);
+        (gap(mid) <= 0 ? t1 : t0) = mid;
+      }
+      return t1;
+    }
+    t0 = t1;
+  }
+  return INFINITY;
+}
+
+double EventEngine::cellExit(int i, int &crossing) const {
+  Vec3 p = _objs->pos.get(i);
+  Vec3 v = _objs->vel.get(i);
+  double result = INFINITY;
+  for (int k = 0; k < 3; ++k) {
+    // the state is current, since predict() follows an event of ball i
+    double x = component(p, k), vx = component(v, k);
+    double ax = 0.5 * component(_g, k);
+    double hi = cellHi(k, _coord[i][k]), lo = cellLo(k, _coord[i][k]);
+    double tHi = hi < INFINITY ? earliestCrossing(x - hi, vx, ax, true)
+                               : INFINITY;
+    double tLo = lo > -INFINITY ? earliestCrossing(x - lo, vx, ax, false)
+                                : INFINITY;
+    if (tHi < result) {
+      result = tHi;
+      crossing = k * 2 + 1;
+    }
+    if (tLo < result) {
+      result = tLo;
+      crossing = k * 2;
+    }
+  }
+  return result;
+}
+
+double EventEngine::wallHit(int i, double horizon, int &tri) const {
+  Vec3 p = _objs->pos.get(i);
+  Vec3 v = _objs->vel.get(i);
+  double r = _objs->radius[i];
+  // the ball stays in its cell until the horizon
+  double lo[3], hi[3];
+  for (int k = 0; k < 3; ++k) {
+    lo[k] = std::max(cellLo(k, _coord[i][k]), _lo[k]) - r;
+    hi[k] = std::min(cellHi(k, _coord[i][k]), _hi[k]) + r;
+  }
+  double result = INFINITY;
+  const BoundaryTri *first = _bounds->tris().data();
+  _bounds->forEachTriIn(lo, hi, [&](const BoundaryTri &t) {
+    double d0 = t.n.dot(p) - t.d;
+    if (d0 <= -r) {
+      return; // behind the face
+    }
+    double vn = t.n.dot(v), gn = t.n.dot(_g);
+    double hit = d0 < r && vn < 0
+                     ? 0
+                     : earliestCrossing(d0 - r, vn, 0.5 * gn, false);
+    if (d0 < r && !(hit < INFINITY) && gn < 0) {
+      // touching and never getting clear: collide when gravity turns the
+      // ball back towards the face
+      hit = -vn / gn;
+    }
+    if (hit < result && hit <= horizon &&
+        t.projectsInside(p + v * hit + _g * (0.5 * hit * hit))) {
+      result = hit;
+      tri = &t - first;
+    }
+  });
+  return result;
+}
+
+void EventEngine::collideBalls(int a, int b) {
+  moveTo(a, _now);
+  moveTo(b, _now);
+  BallStore &objs = *_objs;
+  Vec3 n = (Vec3(objs.pos.get(b)) - Vec3(objs.pos.get(a))).unit();
+  Vec3 va = objs.vel.get(a), vb = objs.vel.get(b);
+  double vn = (va - vb).dot(n);
+  if (vn > 0) {
+    // slow approaches are elastic, so touching balls don't lose their
+    // speed in endless ever-smaller collisions
+    double restSpeed =
+        simParams.tuning_sleepSpeed * simParams.environment_unitsPerMeter;
+    double elasticity =
+        vn < restSpeed ? 1 : std::min(objs.elasticity[a], objs.elasticity[b]);
+    double invMa = objs.selected[a] ? 0 : 1 / objs.mass[a];
+    double invMb = objs.selected[b] ? 0 : 1 / objs.mass[b];
+    double impulse = (1 + elasticity) * vn / (invMa + invMb);
+    objs.vel.set(a, va - n * (impulse * invMa));
+    objs.vel.set(b, vb + n * (impulse * invMb));
+  }
+  _count[a]++;
+  _count[b]++;
+  predict(a);
+  predict(b);
+}
+
+void EventEngine::collideWall(int a, int tri) {
+  moveTo(a, _now);
+  BallStore &objs = *_objs;
+  const Vec3 &n = _bounds->tris()[tri].n;
+  Vec3 v = objs.vel.get(a);
+  // bounces leave at tuning_sleepSpeed at least, so a ball resting on a
+  // wall hops instead of hitting it again at the same instant
+  double restSpeed =
+      simParams.tuning_sleepSpeed * simParams.environment_unitsPerMeter;
+  double vIn = -v.dot(n);
+  double vOut = std::max(objs.elasticity[a] * vIn, restSpeed);
+  objs.vel.set(a, v + n * (vIn + vOut));
+  _count[a]++;
+  predict(a);
+}
+
+void EventEngine::changeCell(int a, int crossing) {
+  moveTo(a, _now);
+  std::vector<int> &old = _cells[cellIndex(_coord[a].data())];
+  old.erase(std::find(old.begin(), old.end(), a));
+  _coord[a][crossing / 2] += crossing % 2 ? 1 : -1;
+  _cells[cellIndex(_coord[a].data())].push_back(a);
+  _count[a]++;
+  predict(a);
+}
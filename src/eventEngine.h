@@ -0,0 +1,86 @@
+/* Event-driven engine for dilute scenes (environment_engine 1). Between
+    collisions balls fly freely under gravity, so instead of stepping, the
+    engine predicts when each ball next hits another ball, hits a boundary
+    triangle, or leaves its grid cell, keeps the predictions in a priority
+    queue, and jumps from event to event. A ball's state is only brought up
+    to date when it takes part in an event or at an output time, and a
+    prediction made before one of its balls' later events is recognised as
+    stale by that ball's event count and dropped when popped.
+
+    Collisions are instantaneous and frictionless, with restitution from
+    the balls' elasticity. Air drag, the Magnus force and sleeping don't
+    apply, and selected balls are held still. */
+
+#ifndef EVENT_ENGINE_H
+#define EVENT_ENGINE_H
+
+#include <array>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "ballStore.h"
+#include "boundary.h"
+#include "vec3d.h"
+
+class EventEngine {
+public:
+  // forget all predictions; the next advance() starts over from the store,
+  // e.g. after balls were added, removed or edited
+  void invalidate() { _valid = false; };
+  // move every ball dt forward in time, processing the events on the way
+  void advance(BallStore &objs, const BoundaryCollider &bounds,
+               const Vec3 &gravity, double dt);
+  long events() const { return _events; }; // processed so far
+
+private:
+  enum class EventType { Ball, Wall, Cell };
+  struct Event {
+    double t;
+    EventType type;
+    int a;      // ball
+    int b;      // other ball, triangle index, or axis * 2 + (1 if upward)
+    int countA; // event counts when predicted
+    int countB;
+    bool operator>(const Event &o) const { return t > o.t; };
+  };
+
+  void init();
+  Vec3 posAt(int i, double t) const;
+  Vec3 velAt(int i, double t) const;
+  void moveTo(int i, double t); // bring ball i's state up to time t
+  // push every event of ball i that can happen before it leaves its cell
+  void predict(int i);
+  double predictPair(int i, int j, double horizon) const;
+  double cellExit(int i, int &crossing) const;
+  double wallHit(int i, double horizon, int &tri) const;
+  void collideBalls(int a, int b);
+  void collideWall(int a, int tri);
+  void changeCell(int a, int crossing);
+
+  int cellIndex(const int coord[3]) const {
+    return (coord[0] * _dims[1] + coord[1]) * _dims[2] + coord[2];
+  };
+  // bounds of a cell along one axis; the outer cells reach to infinity
+  double cellLo(int axis, int coord) const;
+  double cellHi(int axis, int coord) const;
+  void forEachNeighbor(int i, const std::function<void(int)> &f) const;
+
+  BallStore *_objs = nullptr;
+  const BoundaryCollider *_bounds = nullptr;
+  Vec3 _g;
+  bool _valid = false;
+  double _now = 0;
+  long _events = 0;
+
+  std::vector<double> _time;              // per slot, time of its state
+  std::vector<int> _count;                // per slot, events taken part in
+  std::vector<std::array<int, 3>> _coord; // per slot, grid cell
+  std::vector<std::vector<int>> _cells;   // slots in each cell
+  double _lo[3], _hi[3]; // grid bounds, from the boundary mesh
+  double _cellSize;      // at least the largest ball diameter
+  int _dims[3];
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> _queue;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "forceKernels.h"
+#include "simParams.h"
+#include "simd.h"
+
+// global simulation parameters (from XML config file)
+extern SimParameters simParams;
+
+template <typename P> struct PackVec {
+  P x, y, z;
+
+  static PackVec load(const Vec3Array &a, int i) {
+    return {P::load(&a.x[i]), P::load(&a.y[i]), P::load(&a.z[i])};
+  };
+  void store(Vec3Array &a, int i) const {
+    x.store(&a.x[i]);
+    y.store(&a.y[i]);
+    z.store(&a.z[i]);
+  };
+  P mag() const { return sqrt(x * x + y * y + z * z); };
+  // zero below the tolerance, as Vec3::unit()
+  PackVec unit() const {
+    P m = mag();
+    return {ifGe(m, P(Real(EQ_TOLERANCE)), x / m),
+            ifGe(m, P(Real(EQ_TOLERANCE)), y / m),
+            ifGe(m, P(Real(EQ_TOLERANCE)), z / m)};
+  };
+  PackVec cross(const PackVec &v) const {
+    return {y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x};
+  };
+  friend PackVec operator+(const PackVec &a, const PackVec &b) {
+    return {a.x + b.x, a.y + b.y, a.z + b.z};
+  };
+  friend PackVec operator-(const PackVec &a, const PackVec &b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+  };
+  friend PackVec operator*(const PackVec &a, P s) {
+    return {a.x * s, a.y * s, a.z * s};
+  };
+  friend PackVec operator*(P s, const PackVec &a) {
+    return {s * a.x, s * a.y, s * a.z};
+  };
+  friend PackVec operator-(const PackVec &a) { return {-a.x, -a.y, -a.z}; };
+};
+
+template <typename P>
+static PackVec<P> broadcast(const Vec3 &v) {
+  return {P(Real(v.x())), P(Real(v.y())), P(Real(v.z()))};
+}
+
+template <typename P>
+static void bodyForceBlock(BallStore &objs, int i, const Vec3 &gravity,
+                           const Vec3 &wind, double airDensity) {
+  typedef PackVec<P> V;
+  P upm = Real(simParams.environment_unitsPerMeter);
+  P rho = Real(airDensity);
+  V w = broadcast<P>(wind);
+  V vel = V::load(objs.vel, i);
+  V aVel = V::load(objs.aVel, i);
+  V force = V::load(objs.force, i);
+  V torque = V::load(objs.torque, i);
+  P r = P::load(&objs.radius[i]);
+  P m = P::load(&objs.mass[i]);
+
+  // air resistance
+  V rel = w - vel;
+  P relMag = rel.mag();
+  V drag = rel.unit() * P(0.5) * rho * (relMag * relMag) * (r * r) * P(0.5);
+  force = force + drag * upm;
+  // rotational damping
+  torque = torque + (r * r) * -aVel * rho * upm;
+  // Magnus force
+  force = force + aVel.cross(vel.unit() - w) * rho * upm;
+  // gravity
+  force = force + m * broadcast<P>(gravity);
+
+  force.store(objs.force, i);
+  torque.store(objs.torque, i);
+}
+
+template <typename P> static PackVec<P> loadVec(const Real *x, const Real *y,
+                                                const Real *z, int k) {
+  return {P::load(x + k), P::load(y + k), P::load(z + k)};
+}
+
+// same expressions, in the same order, as addContactForce
+template <typename P> static void contactBlock(ContactBatch &b, int k) {
+  typedef PackVec<P> V;
+  P springCoeff = Real(simParams.tuning_objSpringCoeff);
+  P springDamping = Real(simParams.tuning_objSpringDamping);
+  P frictionCoeff = Real(simParams.tuning_objFrictionCoeff);
+  V positionDiff = loadVec<P>(b.dx, b.dy, b.dz, k);
+  V v = loadVec<P>(b.vx, b.vy, b.vz, k);
+  V vOther = loadVec<P>(b.otherVx, b.otherVy, b.otherVz, k);
+  V w = loadVec<P>(b.wx, b.wy, b.wz, k);
+  P r = P::load(b.r + k);
+  P sumRadii = r + P::load(b.otherR + k);
+
+  V velocityDiff = v - vOther;
+  V normal = positionDiff.unit();
+  V reactiveForce =
+      -((springCoeff * (sumRadii - positionDiff.mag())) * normal -
+        springDamping * velocityDiff.unit());
+  V torqueArm = normal * r;
+  V velContactPoint = v + w.cross(torqueArm);
+  P reactiveMag = reactiveForce.mag();
+  V frictionForce = -velContactPoint * frictionCoeff * reactiveMag;
+  V frictionTorque = -w * frictionCoeff * reactiveMag;
+  V force = reactiveForce + frictionForce;
+  V torque = torqueArm.cross(frictionForce) + frictionTorque;
+
+  force.x.store(b.fx + k);
+  force.y.store(b.fy + k);
+  force.z.store(b.fz + k);
+  torque.x.store(b.tx + k);
+  torque.y.store(b.ty + k);
+  torque.z.store(b.tz + k);
+}
+
+void ContactBatch::add(const BallStore &objs, int i, int j) {
+  first[size] = i;
+  dx[size] = objs.pos.x[j] - objs.pos.x[i];
+  dy[size] = objs.pos.y[j] - objs.pos.y[i];
+  dz[size] = objs.pos.z[j] - objs.pos.z[i];
+  vx[size] = objs.vel.x[i];
+  vy[size] = objs.vel.y[i];
+  vz[size] = objs.vel.z[i];
+  otherVx[size] = objs.vel.x[j];
+  otherVy[size] = objs.vel.y[j];
+  otherVz[size] = objs.vel.z[j];
+  wx[size] = objs.aVel.x[i];
+  wy[size] = objs.aVel.y[i];
+  wz[size] = objs.aVel.z[i];
+  r[size] = objs.radius[i];
+  otherR[size] = objs.radius[j];
+  size++;
+}
+
+void addContactForces(ContactBatch &batch, BallStore &objs) {
+  int k = 0;
+  for (; k + PackR::N <= batch.size; k += PackR::N) {
+    contactBlock<PackR>(batch, k);
+  }
+  for (; k < batch.size; ++k) {
+    contactBlock<ScalarR>(batch, k);
+  }
+  // in queue order, so each ball sums its contacts as the scalar code did
+  for (k = 0; k < batch.size; ++k) {
+    objs.force.add(batch.first[k],
+                   Vec3R(batch.fx[k], batch.fy[k], batch.fz[k]));
+    objs.torque.add(batch.first[k],
+                    Vec3R(batch.tx[k], batch.ty[k], batch.tz[k]));
+  }
+  batch.size = 0;
+}
+
+// whether slots [i, i + n) are all asleep
+static bool allSleeping(const BallStore &objs, int i, int n) {
+  for (int k = i; k < i + n; ++k) {
+    if (!objs.sleeping[k]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void addBodyForces(BallStore &objs, int begin, int end, const Vec3 &gravity,
+                   const Vec3 &wind, double airDensity) {
+  int i = begin;
+  for (; i + PackR::N <= end; i += PackR::N) {
+    if (!allSleeping(objs, i, PackR::N)) {
+      bodyForceBlock<PackR>(objs, i, gravity, wind, airDensity);
+    }
+  }
+  for (; i < end; ++i) {
+    if (!allSleeping(objs, i, 1)) {
+      bodyForceBlock<ScalarR>(objs, i, gravity, wind, airDensity);
+    }
+  }
+}
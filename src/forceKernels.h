@@ -0,0 +1,49 @@
+/* Batched force kernels over the structure-of-arrays ball state. Each
+    kernel runs a pack of balls (see simd.h) per iteration, with a scalar
+    tail, and produces the same results as the per-ball Vec3 code it
+    replaces: every lane evaluates the same operations in the same order,
+    without fused multiply-adds, so SIMD and scalar builds agree bit for
+    bit. Against the original Vec3 expressions the only difference is where
+    gravity is added, which moves results by at most a few ulps (relative
+    1e-15) per step; contact forces match addContactForce exactly. The
+    kernels run in Real, on PackR lanes. */
+
+#ifndef FORCE_KERNELS_H
+#define FORCE_KERNELS_H
+
+#include "ballStore.h"
+#include "vec3d.h"
+
+// add air drag (C_d 0.5), rotational damping, Magnus force and gravity
+// (already in visualization units) to force and torque for slots
+// [begin, end); packs of sleeping balls are skipped
+void addBodyForces(BallStore &objs, int begin, int end, const Vec3 &gravity,
+                   const Vec3 &wind, double airDensity);
+
+// colliding ball pairs waiting for addContactForces, packed per field. a
+// pair only adds force and torque to its first ball, as addContactForce
+struct ContactBatch {
+  static const int CAPACITY = 512;
+
+  bool full() const { return size == CAPACITY; };
+  // queue the contact of the ball in slot i with the ball in slot j
+  void add(const BallStore &objs, int i, int j);
+
+  int size = 0;
+  int first[CAPACITY];
+  Real dx[CAPACITY], dy[CAPACITY], dz[CAPACITY]; // other pos - pos
+  Real vx[CAPACITY], vy[CAPACITY], vz[CAPACITY];
+  Real otherVx[CAPACITY], otherVy[CAPACITY], otherVz[CAPACITY];
+  Real wx[CAPACITY], wy[CAPACITY], wz[CAPACITY];
+  Real r[CAPACITY], otherR[CAPACITY];
+  // per-pair results, before they are added to the balls
+  Real fx[CAPACITY], fy[CAPACITY], fz[CAPACITY];
+  Real tx[CAPACITY], ty[CAPACITY], tz[CAPACITY];
+};
+
+// evaluate the spring-damper and friction response of every queued pair,
+// add it to the first balls' force and torque in queue order, and empty
+// the batch
+void addContactForces(ContactBatch &batch, BallStore &objs);
+
+#endif
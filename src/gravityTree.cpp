@@ -0,0 +1,141 @@
+#include "gravityTree.h"
+
+#include <algorithm>
+#include <cmath>
+
+// bodies per leaf
+const int LEAF_SIZE = 8;
+// bodies at (nearly) the same point can't be split; stop splitting there
+const int MAX_DEPTH = 40;
+
+void GravityTree::build(const Vec3Array &positions,
+                        const std::vector<Real> &masses) {
+  int n = positions.size();
+  _pos.resize(n);
+  _mass.resize(n);
+  _order.resize(n);
+  _nodes.clear();
+  if (n == 0) {
+    return;
+  }
+  Vec3 lo = positions.get(0), hi = lo;
+  for (int i = 0; i < n; ++i) {
+    _pos[i] = positions.get(i);
+    _mass[i] = masses[i];
+    _order[i] = i;
+    lo = Vec3(std::min(lo.x(), _pos[i].x()), std::min(lo.y(), _pos[i].y()),
+              std::min(lo.z(), _pos[i].z()));
+    hi = Vec3(std::max(hi.x(), _pos[i].x()), std::max(hi.y(), _pos[i].y()),
+              std::max(hi.z(), _pos[i].z()));
+  }
+  Vec3 extent = hi - lo;
+  double size = std::max({extent.x(), extent.y(), extent.z()});
+  _nodes.reserve(2 * n / LEAF_SIZE + 1);
+  buildNode(0, n, (lo + hi) * 0.5, size, 0);
+}
+
+int GravityTree::buildNode(int begin, int end, const Vec3 &center,
+                           double size, int depth) {
+  int nodeIdx = _nodes.size();
+  _nodes.push_back(GravityNode());
+  GravityNode node;
+  node.size = size;
+  node.mass = 0;
+  Vec3 moment;
+  if (end - begin <= LEAF_SIZE || depth >= MAX_DEPTH) {
+    node.first = begin;
+    node.count = end - begin;
+    for (int b = begin; b < end; ++b) {
+      node.mass += _mass[_order[b]];
+      moment += _pos[_order[b]] * _mass[_order[b]];
+    }
+  } else {
+    // split the bodies into octants: by x, then each half by y, then each
+    // quarter by z
+    auto order = _order.begin();
+    auto below = [&](int axis, double c) {
+      return [this, axis, c](int i) {
+        const Vec3 &p = _pos[i];
+        return (axis == 0 ? p.x() : axis == 1 ? p.y() : p.z()) <= c;
+      };
+    };
+    int bounds[9];
+    bounds[0] = begin;
+    bounds[8] = end;
+    bounds[4] = std::partition(order + begin, order + end,
+                               below(0, center.x())) -
+                order;
+    for (int h = 0; h < 8; h += 4) {
+      bounds[h + 2] = std::partition(order + bounds[h], order + bounds[h + 4],
+                                     below(1, center.y())) -
+                      order;
+    }
+    for (int q = 0; q < 8; q += 2) {
+      bounds[q + 1] = std::partition(order + bounds[q], order + bounds[q + 2],
+                                     below(2, center.z())) -
+                      order;
+    }
+    node.first = -1;
+    node.count = 0;
+    double quarter = size * 0.25;
+    for (int octant = 0; octant < 8; ++octant) {
+      if (bounds[octant] == bounds[octant + 1]) {
+        continue;
+      }
+      Vec3 childCenter = center + Vec3(octant & 4 ? quarter : -quarter,
+                                       octant & 2 ? quarter : -quarter,
+                                       octant & 1 ? quarter : -quarter);
+      int child = buildNode(bounds[octant], bounds[octant + 1], childCenter,
+                            size * 0.5, depth + 1);
+      node.mass += _nodes[child].mass;
+      moment += _nodes[child].com * _nodes[child].mass;
+    }
+  }
+  node.com = node.mass > 0 ? moment / node.mass : center;
+  node.offset = (node.com - center).mag();
+  node.next = _nodes.size();
+  _nodes[nodeIdx] = node;
+  return nodeIdx;
+}
+
+Vec3 GravityTree::accel(int i, double theta, double eps) const {
+  Vec3 result;
+  forEachSource(i, theta, [&](const Vec3 &source, double mass) {
+    Vec3 d = source - _pos[i];
+    double r2 = d.dot(d) + eps * eps;
+    result += d * (mass / (r2 * std::sqrt(r2)));
+  });
+  return result;
+}
+
+double GravityTree::potential(int i, double theta, double eps) const {
+  double result = 0;
+  forEachSource(i, theta, [&](const Vec3 &source, double mass) {
+    Vec3 d = source - _pos[i];
+    result -= mass / std::sqrt(d.dot(d) + eps * eps);
+  });
+  return result;
+}
+
+Vec3 GravityTree::directAccel(int i, double eps) const {
+  Vec3 result;
+  for (int j = 0; j < size(); ++j) {
+    if (j != i) {
+      Vec3 d = _pos[j] - _pos[i];
+      double r2 = d.dot(d) + eps * eps;
+      result += d * (_mass[j] / (r2 * std::sqrt(r2)));
+    }
+  }
+  return result;
+}
+
+double GravityTree::directPotential(int i, double eps) const {
+  double result = 0;
+  for (int j = 0; j < size(); ++j) {
+    if (j != i) {
+      Vec3 d = _pos[j] - _pos[i];
+      result -= _mass[j] / std::sqrt(d.dot(d) + eps * eps);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,82 @@
+/* Barnes-Hut octree for mutual gravitation between balls. Bodies are
+    split into octants until a cell holds a few bodies; every cell keeps its
+    total mass and center of mass. The pull on a body sums the bodies of
+    nearby cells directly, and stands in for each far cell with a point
+    mass at its center of mass, which makes one evaluation for all bodies
+    O(n log n). */
+
+#ifndef GRAVITY_TREE_H
+#define GRAVITY_TREE_H
+
+#include <vector>
+
+#include "vec3d.h"
+
+// octree node; nodes are stored depth first, so an inner node's first
+// child is the next node, and next skips over the whole subtree
+struct GravityNode {
+  Vec3 com;      // center of mass
+  double mass;   // of all bodies below
+  double size;   // cube edge length
+  double offset; // distance from the cube center to com
+  int next;
+  int first; // leaf: first body in the tree's body order
+  int count; // bodies in leaf (0 for inner nodes)
+};
+
+class GravityTree {
+public:
+  // rebuild from body centers and masses
+  void build(const Vec3Array &positions, const std::vector<Real> &masses);
+  int size() const { return _pos.size(); };
+  const std::vector<GravityNode> &nodes() const { return _nodes; };
+
+  // acceleration and potential at body i for a gravitational constant of
+  // one, with Plummer softening length eps. a cell is opened when the body
+  // is closer to its center of mass than size / theta (plus the center of
+  // mass offset, so a body inside a cell always opens it); theta 0 opens
+  // every cell
+  Vec3 accel(int i, double theta, double eps) const;
+  double potential(int i, double theta, double eps) const;
+  // the same sums over every other body without the tree, O(n) per body;
+  // for validation
+  Vec3 directAccel(int i, double eps) const;
+  double directPotential(int i, double eps) const;
+
+private:
+  // call f(source, mass) for each body or far cell body i interacts with
+  template <typename F>
+  void forEachSource(int i, double theta, F f) const;
+  int buildNode(int begin, int end, const Vec3 &center, double size,
+                int depth);
+
+  std::vector<Vec3> _pos;
+  std::vector<double> _mass;
+  std::vector<int> _order; // bodies in leaf order
+  std::vector<GravityNode> _nodes;
+};
+
+template <typename F>
+void GravityTree::forEachSource(int i, double theta, F f) const {
+  const Vec3 &p = _pos[i];
+  int k = 0;
+  while (k < int(_nodes.size())) {
+    const GravityNode &node = _nodes[k];
+    if (node.count > 0) {
+      for (int b = node.first; b < node.first + node.count; ++b) {
+        if (_order[b] != i) {
+          f(_pos[_order[b]], _mass[_order[b]]);
+        }
+      }
+      k = node.next;
+    } else if (theta > 0 &&
+               (p - node.com).mag() > node.size / theta + node.offset) {
+      f(node.com, node.mass);
+      k = node.next;
+    } else {
+      k++;
+    }
+  }
+}
+
+#endif
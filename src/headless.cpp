@@ -0,0 +1,133 @@
+/* Headless batch runner: steps an environment from a config and a scene
+    file as fast as possible, with no window and no wall-clock throttling.
+
+    Scene files list one ball per line, in the same units as interactive
+    ball creation (position in visualization units, everything else SI):
+      x y z  vx vy vz  radius  [wx wy wz  [elasticity]]
+    A missing elasticity is tuning_elasticity. Radii must be positive and
+    at most controls_radius max, which the broadphase takes as the largest
+    ball.
+    Blank lines and lines starting with '#' are ignored.
+
+    --load resumes from a checkpoint (scene balls are added on top) and
+    --save writes one after the last step. */
+
+#include <argparse/argparse.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "bbox.h"
+#include "boundary.h"
+#include "env3d.h"
+#include "profiler.h"
+#include "simParams.h"
+
+// global parameters; used by all objects after initialization
+SimParameters simParams;
+
+// add the balls listed in a scene file; returns the number added
+int loadScene(Environment &env, const std::string &fileName) {
+  std::ifstream file(fileName);
+  if (!file) {
+    std::cerr << "warning: could not open scene \"" << fileName << "\"\n";
+    return 0;
+  }
+  int count = 0;
+  std::string line;
+  int lineNum = 0;
+  while (std::getline(file, line)) {
+    lineNum++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream tokens(line);
+    double x, y, z, vx, vy, vz, radius, wx = 0, wy = 0, wz = 0;
+    double elasticity = simParams.tuning_elasticity;
+    if (!(tokens >> x >> y >> z >> vx >> vy >> vz >> radius)) {
+      std::cerr << "warning: skipping malformed scene line " << lineNum
+                << "\n";
+      continue;
+    }
+    if (!(radius > 0 && radius <= simParams.controls_radius[1])) {
+      std::cerr << "warning: skipping scene line " << lineNum
+                << ": radius " << radius << " is outside (0, "
+                << simParams.controls_radius[1] << "]\n";
+      continue;
+    }
+    tokens >> wx >> wy >> wz >> elasticity;
+    Vec3 pos(x, y, z);
+    double r = radius * simParams.environment_unitsPerMeter;
+    env.addObj(Ball(BBox(pos, r * 2.0), pow(r, 3), pos,
+                    Vec3(vx, vy, vz) * simParams.environment_unitsPerMeter,
+                    elasticity, Vec3(wx, wy, wz)));
+    count++;
+  }
+  return count;
+}
+
+int main(int argc, char *argv[]) {
+  argparse::ArgumentParser argParser("gravity_sim_headless");
+  argParser.add_argument("-c", "--config").default_value("").nargs(1);
+  argParser.add_argument("-s", "--scene").default_value("").nargs(1);
+  argParser.add_argument("-l", "--load").default_value("").nargs(1);
+  argParser.add_argument("-o", "--save").default_value("").nargs(1);
+  argParser.add_argument("-n", "--steps").default_value(1000).scan<'i', int>();
+  argParser.parse_args(argc, argv);
+  simParams = parseXmlConfig(argParser.get<std::string>("--config"));
+
+  Environment env(simParams.environment_gravity *
+                      simParams.environment_unitsPerMeter,
+                  1.0 / simParams.environment_frameRate);
+  env.setWind(simParams.environment_wind);
+  env.setAirDensity(simParams.environment_airDensity);
+  env.setBounds(BoundaryCollider::fromObjFile(simParams.environment_boundary));
+
+  std::string loadFile = argParser.get<std::string>("--load");
+  if (!loadFile.empty() && !env.load(loadFile)) {
+    return 1;
+  }
+  std::string sceneFile = argParser.get<std::string>("--scene");
+  if (!sceneFile.empty()) {
+    loadScene(env, sceneFile);
+  }
+
+  int steps = argParser.get<int>("--steps");
+  std::cerr << "running " << steps << " steps with " << env.objs().size()
+            << " balls, " << env.bounds().tris().size()
+            << " boundary triangles\n";
+
+  auto tStart = std::chrono::steady_clock::now();
+  for (int i = 0; i < steps; ++i) {
+    env.update();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - tStart)
+                       .count();
+
+  std::cout << "steps " << steps << " balls " << env.objs().size()
+            << " sim time " << steps * env.dt() << " s wall time " << seconds
+            << " s (" << steps / seconds << " steps/s, "
+            << steps * env.objs().size() / seconds << " ball-steps/s)\n";
+  std::cout << "energy " << env.computeEnergy() << " sleeping "
+            << env.sleepingObjs() << " integration steps " << env.steps()
+            << " force evaluations " << env.forceEvals() << " events "
+            << env.events() << "\n";
+  if (simParams.environment_neighborLists) {
+    const NeighborList &lists = env.neighbors();
+    std::cout << "neighbor lists built " << lists.builds() << " times in "
+              << lists.checks() << " steps ("
+              << 100.0 * lists.builds() / std::max(lists.checks(), 1L)
+              << "%), mean length " << lists.meanLength() << "\n";
+  }
+  PROFILE_DUMP(std::cerr);
+
+  std::string saveFile = argParser.get<std::string>("--save");
+  if (!saveFile.empty() && !env.save(saveFile)) {
+    return 1;
+  }
+  return 0;
+}
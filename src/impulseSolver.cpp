@@ -0,0 +1,122 @@
+#include "impulseSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "simParams.h"
+
+// global simulation parameters (from XML config file)
+extern SimParameters simParams;
+
+void ImpulseSolver::reset(int chunks) {
+  _chunks.resize(chunks);
+  for (std::vector<Contact> &c : _chunks) {
+    c.clear();
+  }
+}
+
+int ImpulseSolver::size() const {
+  int result = 0;
+  for (const std::vector<Contact> &c : _chunks) {
+    result += c.size();
+  }
+  return result;
+}
+
+void ImpulseSolver::prepare(Contact &c, const BallStore &objs,
+                            Real dt) const {
+  auto inverses = [&](int i, Real &invM, Real &invI) {
+    bool fixed = i < 0 || objs.selected[i] || objs.sleeping[i];
+    invM = fixed ? 0 : 1 / objs.mass[i];
+    invI = fixed ? 0
+                 : 1 / (Real(0.4) * objs.mass[i] * objs.radius[i] *
+                        objs.radius[i]);
+  };
+  inverses(c.a, c.invMa, c.invIa);
+  inverses(c.b, c.invMb, c.invIb);
+  c.ra = objs.radius[c.a];
+  c.rb = c.b < 0 ? 0 : objs.radius[c.b];
+
+  // any unit vector not parallel to n gives the tangent plane
+  Vec3R axis = std::abs(c.n.x()) < Real(0.6) ? Vec3R(1, 0, 0) : Vec3R(0, 1, 0);
+  c.t1 = c.n.cross(axis).unit();
+  c.t2 = c.n.cross(c.t1);
+  // both contact arms are parallel to n, so only the tangents turn the balls
+  c.massN = 1 / (c.invMa + c.invMb);
+  c.massT = 1 / (c.invMa + c.invMb + c.invIa * c.ra * c.ra +
+                 c.invIb * c.rb * c.rb);
+
+  Real elasticity = c.b < 0 ? objs.elasticity[c.a]
+                            : std::min(objs.elasticity[c.a],
+                                       objs.elasticity[c.b]);
+  Real vn = relativeVel(c, objs).dot(c.n);
+  // below the speed gravity adds in two steps, contacts are resting and
+  // don't bounce
+  Real restThreshold = 2 * simParams.environment_gravity.mag() *
+                       simParams.environment_unitsPerMeter * dt;
+  Real bounce = vn < -restThreshold ? -elasticity * vn : 0;
+  Real slop = simParams.tuning_penetrationSlop *
+              (c.b < 0 ? c.ra : std::min(c.ra, c.rb));
+  Real push = simParams.tuning_penetrationCorrection / dt *
+              std::max<Real>(c.depth - slop, 0);
+  c.bias = std::max(bounce, push);
+  c.jn = c.jt1 = c.jt2 = 0;
+}
+
+// velocity of b's contact point relative to a's, at the shared point
+Vec3R ImpulseSolver::relativeVel(const Contact &c,
+                                 const BallStore &objs) const {
+  Vec3R va = objs.vel.get(c.a) + objs.aVel.get(c.a).cross(c.n * c.ra);
+  if (c.b < 0) {
+    return -va;
+  }
+  Vec3R vb = objs.vel.get(c.b) + objs.aVel.get(c.b).cross(c.n * -c.rb);
+  return vb - va;
+}
+
+// impulse p on b, and -p on a
+void ImpulseSolver::applyImpulse(const Contact &c, BallStore &objs,
+                                 const Vec3R &p) const {
+  if (c.invMa > 0) {
+    objs.vel.add(c.a, p * -c.invMa);
+    objs.aVel.add(c.a, (c.n * c.ra).cross(p) * -c.invIa);
+  }
+  if (c.b >= 0 && c.invMb > 0) {
+    objs.vel.add(c.b, p * c.invMb);
+    objs.aVel.add(c.b, (c.n * -c.rb).cross(p) * c.invIb);
+  }
+}
+
+void ImpulseSolver::solve(BallStore &objs, Real dt) {
+  for (std::vector<Contact> &chunk : _chunks) {
+    for (Contact &c : chunk) {
+      prepare(c, objs, dt);
+    }
+  }
+  Real friction = simParams.tuning_objFrictionCoeff;
+  for (int it = 0; it < simParams.tuning_solverIterations; ++it) {
+    for (std::vector<Contact> &chunk : _chunks) {
+      for (Contact &c : chunk) {
+        if (c.invMa == 0 && c.invMb == 0) {
+          continue;
+        }
+        // normal: push only
+        Real vn = relativeVel(c, objs).dot(c.n);
+        Real jn = std::max<Real>(c.jn + c.massN * (c.bias - vn), 0);
+        applyImpulse(c, objs, c.n * (jn - c.jn));
+        c.jn = jn;
+
+        // friction, within the cone of the current normal impulse
+        Real maxFriction = friction * c.jn;
+        Vec3R v = relativeVel(c, objs);
+        Real jt1 = std::clamp(c.jt1 - c.massT * v.dot(c.t1), -maxFriction,
+                              maxFriction);
+        Real jt2 = std::clamp(c.jt2 - c.massT * v.dot(c.t2), -maxFriction,
+                              maxFriction);
+        applyImpulse(c, objs, c.t1 * (jt1 - c.jt1) + c.t2 * (jt2 - c.jt2));
+        c.jt1 = jt1;
+        c.jt2 = jt2;
+      }
+    }
+  }
+}
@@ -0,0 +1,60 @@
+/* Sequential impulse (projected Gauss-Seidel) contact solver, the
+    alternative to penalty springs (environment_contacts 1). Contacts are
+    velocity constraints, solved after the non-contact forces have been
+    applied for the step: every iteration visits each contact in order and
+    applies the normal impulse that stops the balls approaching (plus
+    restitution, and a push out of deep overlaps), clamped so contacts only
+    push, then Coulomb friction along two tangents, bounded by the normal
+    impulse. Stiffness never enters, so steps can be many times longer than
+    the spring contacts allow. */
+
+#ifndef IMPULSE_SOLVER_H
+#define IMPULSE_SOLVER_H
+
+#include <vector>
+
+#include "ballStore.h"
+#include "vec3d.h"
+
+class ImpulseSolver {
+public:
+  // contacts are gathered in parallel, one list per chunk of slots, and
+  // solved chunk by chunk, so they are visited in slot order for any
+  // number of chunks
+  void reset(int chunks);
+  // ball a overlapping ball b by depth, n the unit normal from a to b
+  void addBallContact(int chunk, int a, int b, const Vec3R &n, Real depth) {
+    _chunks[chunk].push_back({a, b, n, depth});
+  };
+  // ball a overlapping a wall by depth, n the unit normal into the wall
+  void addWallContact(int chunk, int a, const Vec3R &n, Real depth) {
+    _chunks[chunk].push_back({a, -1, n, depth});
+  };
+  int size() const;
+
+  // change the velocities of the balls so the contacts hold; selected and
+  // sleeping balls don't move
+  void solve(BallStore &objs, Real dt);
+
+private:
+  struct Contact {
+    int a, b;   // slots; b is -1 for a wall
+    Vec3R n;    // unit normal from a towards b
+    Real depth; // overlap
+    // filled in by solve()
+    Vec3R t1, t2;                  // friction directions
+    Real invMa, invIa, invMb, invIb; // zero for balls that don't move
+    Real ra, rb;                   // contact point distance from centers
+    Real massN, massT;             // effective mass along n and along t
+    Real bias;                     // normal separation speed to reach
+    Real jn, jt1, jt2;             // accumulated impulses
+  };
+
+  void prepare(Contact &c, const BallStore &objs, Real dt) const;
+  void applyImpulse(const Contact &c, BallStore &objs, const Vec3R &p) const;
+  Vec3R relativeVel(const Contact &c, const BallStore &objs) const;
+
+  std::vector<std::vector<Contact>> _chunks;
+};
+
+#endif
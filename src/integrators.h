@@ -0,0 +1,140 @@
+/* Integration schemes for the environment step, as compile-time policies:
+    Environment::stepObjs<I>() is instantiated once per scheme, so the
+    per-ball calls inline and the scheme costs no dispatch inside the loop.
+
+    A scheme evaluates forces STAGES times per step. Before each evaluation,
+    begin() may move a ball to where the forces are wanted; after it,
+    advance() turns the ball's force and torque into motion. Forces never
+    depend on orientation, so rotation is only advanced with the final
+    angular velocity of a stage. */
+
+#ifndef INTEGRATORS_H
+#define INTEGRATORS_H
+
+#include "ball.h"
+#include "quaternion.h"
+#include "vec3d.h"
+
+// schemes selectable with environment_integrator
+enum class Integrator {
+  ConstantAccelRK4 = 0, // RK4 with the step's forces held fixed (original)
+  SymplecticEuler = 1,
+  VelocityVerlet = 2,
+  RK4 = 3 // classic RK4, forces re-evaluated at every stage
+};
+
+// one ball, gathered from the BallStore for a begin() or advance() call
+struct BallState {
+  Real m, r;
+  Vec3R pos, vel, aVel;
+  QuaternionR rot;
+  Vec3R accel, aAccel; // from the previous evaluation until advance()
+  Vec3R force, torque; // net force and torque of this evaluation
+};
+
+// per-ball values a scheme keeps between the stages of one step
+struct StageScratch {
+  Vec3R pos0, vel0, aVel0;  // state at the start of the step
+  Vec3R dPos, dVel, dAVel;  // weighted sum of the stage derivatives
+  Vec3R force0, torque0;    // forces applied from outside the step
+};
+
+inline void rotateBy(QuaternionR &rot, const Vec3R &aVel, Real dt) {
+  QuaternionR aVelQuat(aVel.mag() > 0 ? aVel.unit() : Vec3R(0, 1, 0),
+                       aVel.mag() * dt);
+  rot = rot * aVelQuat;
+}
+
+inline void updateAccel(BallState &s) {
+  s.accel = s.force / s.m;
+  s.aAccel = s.torque / (Real(0.4) * s.m * (s.r * s.r));
+}
+
+// integrateBall: rk4() with the acceleration constant over the step. one
+// force evaluation; kept as the default so existing scenes are unchanged
+struct ConstantAccelRK4 {
+  static const int STAGES = 1;
+  static void begin(int stage, Real dt, BallState &s, StageScratch &k) {};
+  static void advance(int stage, Real dt, BallState &s, StageScratch &k) {
+    integrateBall(dt, s.m, s.r, s.force, s.torque, s.pos, s.vel, s.accel,
+                  s.aVel, s.rot);
+    s.aAccel = s.torque / (Real(0.4) * s.m * (s.r * s.r));
+  };
+};
+
+// kick then drift; first order, but symplectic and the cheapest scheme
+struct SymplecticEuler {
+  static const int STAGES = 1;
+  static void begin(int stage, Real dt, BallState &s, StageScratch &k) {};
+  static void advance(int stage, Real dt, BallState &s, StageScratch &k) {
+    updateAccel(s);
+    s.vel += s.accel * dt;
+    s.aVel += s.aAccel * dt;
+    s.pos += s.vel * dt;
+    rotateBy(s.rot, s.aVel, dt);
+  };
+};
+
+// half kick with the previous step's acceleration, drift, evaluate forces
+// at the new positions, half kick. second order with one force evaluation
+// per step; velocity-dependent forces see the half-step velocity
+struct VelocityVerlet {
+  static const int STAGES = 1;
+  static void begin(int stage, Real dt, BallState &s, StageScratch &k) {
+    s.vel += s.accel * (Real(0.5) * dt);
+    s.aVel += s.aAccel * (Real(0.5) * dt);
+    s.pos += s.vel * dt;
+    rotateBy(s.rot, s.aVel, dt);
+  };
+  static void advance(int stage, Real dt, BallState &s, StageScratch &k) {
+    updateAccel(s);
+    s.vel += s.accel * (Real(0.5) * dt);
+    s.aVel += s.aAccel * (Real(0.5) * dt);
+  };
+};
+
+// classic fourth-order Runge-Kutta over position, velocity and angular
+// velocity, with all forces (contacts included) evaluated at each of the
+// four stages. four times the force work of the other schemes
+struct RK4 {
+  static const int STAGES = 4;
+  static void begin(int stage, Real dt, BallState &s, StageScratch &k) {
+    if (stage == 0) {
+      k.pos0 = s.pos;
+      k.vel0 = s.vel;
+      k.aVel0 = s.aVel;
+      k.dPos = k.dVel = k.dAVel = Vec3R();
+      // forces applied from outside (e.g. kicks) act at every stage
+      k.force0 = s.force;
+      k.torque0 = s.torque;
+    } else {
+      s.force = k.force0;
+      s.torque = k.torque0;
+    }
+  };
+  static void advance(int stage, Real dt, BallState &s, StageScratch &k) {
+    static const Real weight[STAGES] = {1, 2, 2, 1};
+    static const Real nextStep[STAGES] = {0.5, 0.5, 1, 0};
+    updateAccel(s);
+    k.dPos += s.vel * weight[stage];
+    k.dVel += s.accel * weight[stage];
+    k.dAVel += s.aAccel * weight[stage];
+    if (stage < STAGES - 1) {
+      Real h = nextStep[stage] * dt;
+      s.pos = k.pos0 + s.vel * h;
+      s.vel = k.vel0 + s.accel * h;
+      s.aVel = k.aVel0 + s.aAccel * h;
+    } else {
+      Real h = dt / Real(6);
+      Vec3R aVelMean = k.aVel0 + k.dAVel * (Real(0.5) * h);
+      s.pos = k.pos0 + k.dPos * h;
+      s.vel = k.vel0 + k.dVel * h;
+      s.aVel = k.aVel0 + k.dAVel * h;
+      s.accel = k.dVel / Real(6);
+      s.aAccel = k.dAVel / Real(6);
+      rotateBy(s.rot, aVelMean, dt);
+    }
+  };
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "morton.h"
+
+#include <algorithm>
+#include <cmath>
+
+// spread the low 21 bits of v so two zero bits follow each
+static uint64_t spreadBits(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffff;
+  v = (v | v << 16) & 0x1f0000ff0000ff;
+  v = (v | v << 8) & 0x100f00f00f00f00f;
+  v = (v | v << 4) & 0x10c30c30c30c30c3;
+  v = (v | v << 2) & 0x1249249249249249;
+  return v;
+}
+
+uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z) {
+  return spreadBits(x) | spreadBits(y) << 1 | spreadBits(z) << 2;
+}
+
+std::vector<int> mortonOrder(const Vec3Array &positions, double cellSize) {
+  int n = positions.size();
+  std::vector<int> order(n);
+  if (n == 0) {
+    return order;
+  }
+  Real lo[3] = {positions.x[0], positions.y[0], positions.z[0]};
+  for (int i = 1; i < n; ++i) {
+    lo[0] = std::min(lo[0], positions.x[i]);
+    lo[1] = std::min(lo[1], positions.y[i]);
+    lo[2] = std::min(lo[2], positions.z[i]);
+  }
+  // cells past 2^21 along an axis share the last one; NaNs go first
+  auto cell = [&](Real v, Real low) {
+    double c = std::floor((v - low) / cellSize);
+    return c >= 0 ? uint32_t(std::min(c, 2097151.0)) : 0u;
+  };
+  std::vector<uint64_t> codes(n);
+  for (int i = 0; i < n; ++i) {
+    codes[i] = mortonCode(cell(positions.x[i], lo[0]),
+                          cell(positions.y[i], lo[1]),
+                          cell(positions.z[i], lo[2]));
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](int a, int b) { return codes[a] < codes[b]; });
+  return order;
+}
@@ -0,0 +1,42 @@
+#include "neighborList.h"
+
+#include <algorithm>
+
+bool NeighborList::stale(const Vec3Array &positions, Real scale) {
+  _checks++;
+  if (!_valid || scale != _scale || positions.size() != _buildPos.size()) {
+    return true;
+  }
+  Real limit = Real(0.5) * _skin;
+  for (int i = 0; i < positions.size(); ++i) {
+    if ((positions.get(i) - _buildPos.get(i)).mag() > limit) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void NeighborList::build(const Vec3Array &positions,
+                         const std::vector<Real> &radii, Real scale, Real skin,
+                         const CandidateSource &candidates) {
+  int n = positions.size();
+  _buildPos = positions;
+  _scale = scale;
+  _skin = skin;
+  _start.resize(n + 1);
+  _entries.clear();
+  for (int i = 0; i < n; ++i) {
+    _start[i] = _entries.size();
+    Vec3R pos = positions.get(i);
+    candidates(i, [&](int j) {
+      if (j != i && (positions.get(j) - pos).mag() <
+                        scale * (radii[i] + radii[j]) + skin) {
+        _entries.push_back(j);
+      }
+    });
+    std::sort(_entries.begin() + _start[i], _entries.end());
+  }
+  _start[n] = _entries.size();
+  _valid = true;
+  _builds++;
+}
@@ -0,0 +1,58 @@
+/* Verlet neighbor lists for the contact pass (environment_neighborLists).
+    Each ball keeps the balls within its contact distance plus a skin
+    margin. While no ball has moved more than half the skin since the lists
+    were built, no pair outside them can have come into contact, so the
+    broadphase only runs when some ball has. */
+
+#ifndef NEIGHBOR_LIST_H
+#define NEIGHBOR_LIST_H
+
+#include <functional>
+#include <vector>
+
+#include "vec3d.h"
+
+class NeighborList {
+public:
+  // call f(j) for each candidate of ball i
+  typedef std::function<void(int, const std::function<void(int)> &)>
+      CandidateSource;
+
+  // force a rebuild at the next check, e.g. after balls were edited
+  void invalidate() { _valid = false; };
+  // whether the lists must be rebuilt before use: always after
+  // invalidate(), a change in ball count or scale, or once some ball moved
+  // more than half the skin since the last build. counts as a check
+  bool stale(const Vec3Array &positions, Real scale);
+  // keep, for each ball i, the balls j closer than scale * (r_i + r_j) +
+  // skin, taken from the candidates; candidates must include them all
+  void build(const Vec3Array &positions, const std::vector<Real> &radii,
+             Real scale, Real skin, const CandidateSource &candidates);
+
+  // call f(j) for each ball j in i's list, in slot order
+  template <typename F> void forEachNear(int i, F f) const {
+    for (int k = _start[i]; k < _start[i + 1]; ++k) {
+      f(_entries[k]);
+    }
+  };
+
+  // statistics for tuning the skin
+  long builds() const { return _builds; };
+  long checks() const { return _checks; };
+  double meanLength() const {
+    return _buildPos.size() > 0 ? double(_entries.size()) / _buildPos.size()
+                                : 0;
+  };
+
+private:
+  bool _valid = false;
+  Real _scale = 1;
+  Real _skin = 0;
+  long _builds = 0;
+  long _checks = 0;
+  Vec3Array _buildPos;       // positions at the last build
+  std::vector<int> _start;   // per ball, offset of its list in _entries
+  std::vector<int> _entries; // all lists, one after the other
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "profiler.h"
+
+#ifdef PROFILING
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+#include "simParams.h"
+
+// global simulation parameters (from XML config file)
+extern SimParameters simParams;
+
+static const char *phaseNames[int(Phase::Count)] = {
+    "collide", "bodyForces", "boundary", "integrate", "solve",
+    "gravity",   "drawSim"};
+
+// values below SUB_BUCKETS get a bucket each; above that, each power of two
+// is split into SUB_BUCKETS equal parts
+int Histogram::bucketOf(uint64_t ns) {
+  if (ns < SUB_BUCKETS) {
+    return ns;
+  }
+  int e = std::bit_width(ns) - 1; // >= 3
+  int sub = (ns >> (e - 3)) & (SUB_BUCKETS - 1);
+  return (e - 2) * SUB_BUCKETS + sub;
+}
+
+uint64_t Histogram::bucketTop(int bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  int e = bucket / SUB_BUCKETS + 2;
+  uint64_t sub = bucket % SUB_BUCKETS;
+  return ((SUB_BUCKETS + sub + 1) << (e - 3)) - 1;
+}
+
+void Histogram::add(uint64_t ns) {
+  _buckets[bucketOf(ns)]++;
+  _count++;
+  _max = std::max(_max, ns);
+}
+
+uint64_t Histogram::percentile(double p) const {
+  uint64_t target = std::max<uint64_t>(1, std::ceil(p * _count));
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += _buckets[i];
+    if (seen >= target) {
+      return std::min(bucketTop(i), _max);
+    }
+  }
+  return _max;
+}
+
+void Histogram::clear() {
+  _buckets.fill(0);
+  _count = 0;
+  _max = 0;
+}
+
+Profiler::Profiler() : _lastDump(std::chrono::steady_clock::now()) {
+  for (auto &p : _pending) {
+    p = 0;
+  }
+}
+
+Profiler &Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+void Profiler::record(Phase p, uint64_t ns) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _hists[int(p)].add(ns);
+}
+
+void Profiler::endStep() {
+  for (int i = 0; i < int(Phase::Count); ++i) {
+    uint64_t ns = _pending[i].exchange(0, std::memory_order_relaxed);
+    if (ns > 0) {
+      record(Phase(i), ns);
+    }
+  }
+  if (simParams.environment_profileInterval > 0) {
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - _lastDump).count() >=
+        simParams.environment_profileInterval) {
+      _lastDump = now;
+      std::ofstream file(simParams.environment_profileFile, std::ios::app);
+      dump(file);
+    }
+  }
+}
+
+void Profiler::dump(std::ostream &out) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  out << std::left << std::setw(12) << "phase" << std::right << std::setw(10)
+      << "samples" << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+      << std::setw(12) << "max us" << "\n";
+  out << std::fixed << std::setprecision(2);
+  for (int i = 0; i < int(Phase::Count); ++i) {
+    const Histogram &h = _hists[i];
+    out << std::left << std::setw(12) << phaseNames[i] << std::right
+        << std::setw(10) << h.count() << std::setw(12)
+        << h.percentile(0.5) * 1e-3 << std::setw(12)
+        << h.percentile(0.99) * 1e-3 << std::setw(12) << h.max() * 1e-3
+        << "\n";
+  }
+  out << std::defaultfloat << std::setprecision(6);
+}
+
+void Profiler::clear() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (Histogram &h : _hists) {
+    h.clear();
+  }
+}
+
+#endif
@@ -0,0 +1,141 @@
+/* Per-phase timing for the step and render loops. Built only with
+    -DPROFILING (make PROFILE=1); otherwise every PROFILE_* macro expands to
+    nothing and no timing code is compiled in.
+
+    Each phase keeps a log-bucketed histogram of samples (one sample per
+    environment step, or per frame for drawSim) and reports p50/p99/max. */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifdef PROFILING
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+enum class Phase {
+  Collide,    // broadphase and ball pair loop
+  BodyForces, // drag, rotational damping and Magnus force
+  Boundary,   // boundary contact query
+  Integrate,  // wall force and integration
+  Solve,      // impulse contact solver (environment_contacts 1)
+  Gravity,    // mutual gravity tree build and walks
+  DrawSim,    // render sync and draw
+  Count
+};
+
+// sample values in ns; 8 buckets per power of two (about 9% resolution)
+class Histogram {
+public:
+  Histogram() { clear(); };
+
+  void add(uint64_t ns);
+  uint64_t count() const { return _count; };
+  uint64_t max() const { return _max; };
+  uint64_t percentile(double p) const; // bucket upper bound, ns
+  void clear();
+
+private:
+  static const int SUB_BUCKETS = 8;
+  static const int BUCKETS = 64 * SUB_BUCKETS;
+  static int bucketOf(uint64_t ns);
+  static uint64_t bucketTop(int bucket);
+
+  std::array<uint64_t, BUCKETS> _buckets;
+  uint64_t _count;
+  uint64_t _max;
+};
+
+class Profiler {
+public:
+  static Profiler &instance();
+
+  // whole-phase sample, e.g. one drawSim call
+  void record(Phase p, uint64_t ns);
+  // part of this step's time for a phase; may be called from worker
+  // threads, and is summed until endStep()
+  void accumulate(Phase p, uint64_t ns) {
+    _pending[int(p)].fetch_add(ns, std::memory_order_relaxed);
+  };
+  // turn the accumulated step phases into one sample each, and append a
+  // report to the profile file every environment_profileInterval seconds
+  void endStep();
+
+  void dump(std::ostream &out);
+  void clear();
+
+private:
+  Profiler();
+
+  std::mutex _mutex; // guards the histograms
+  std::array<Histogram, int(Phase::Count)> _hists;
+  std::array<std::atomic<uint64_t>, int(Phase::Count)> _pending;
+  std::chrono::steady_clock::time_point _lastDump;
+};
+
+inline uint64_t profileNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// records one sample for its lifetime
+class ScopedTimer {
+public:
+  ScopedTimer(Phase p) : _phase(p), _start(profileNow()) {};
+  ~ScopedTimer() { Profiler::instance().record(_phase, profileNow() - _start); };
+
+private:
+  Phase _phase;
+  uint64_t _start;
+};
+
+// splits a loop body into consecutive phases: lap(p) charges the time since
+// the previous lap to p. totals are kept locally and handed to the profiler
+// once, when the timer goes out of scope
+class LapTimer {
+public:
+  LapTimer() : _last(profileNow()), _totals{} {};
+  ~LapTimer() {
+    for (int i = 0; i < int(Phase::Count); ++i) {
+      if (_totals[i] > 0) {
+        Profiler::instance().accumulate(Phase(i), _totals[i]);
+      }
+    }
+  };
+  void lap(Phase p) {
+    uint64_t now = profileNow();
+    _totals[int(p)] += now - _last;
+    _last = now;
+  };
+
+private:
+  uint64_t _last;
+  uint64_t _totals[int(Phase::Count)];
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase)                                                   \
+  ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(phase)
+#define PROFILE_LAP_TIMER(name) LapTimer name
+#define PROFILE_LAP(name, phase) name.lap(phase)
+#define PROFILE_END_STEP() Profiler::instance().endStep()
+#define PROFILE_DUMP(out) Profiler::instance().dump(out)
+
+#else
+
+#define PROFILE_SCOPE(phase)
+#define PROFILE_LAP_TIMER(name)
+#define PROFILE_LAP(name, phase)
+#define PROFILE_END_STEP()
+#define PROFILE_DUMP(out)
+
+#endif
+
+#endif
@@ -1,45 +1,103 @@
+/* A rotation quaternion. Header-only and trivially copyable, like Vec3T;
+    Quaternion is the double-precision rotation, QuaternionR the one stored
+    with the simulation state. */
+
 #ifndef QUATERNION_H
 #define QUATERNION_H
 
+#include <cmath>
+#include <type_traits>
+
 #include "vec3d.h"
 
-class Quaternion {
+template <typename T> class QuatT {
 public:
-  // ctor, dtor
-  Quaternion(); // identity quaternion
-  Quaternion(const Vec3 &axis, double angle);
-  Quaternion(double w, double x, double y, double z);
-  Quaternion(const Quaternion &q);
-  Quaternion &operator=(const Quaternion &q);
-  ~Quaternion();
+  typedef T Scalar;
+
+  // ctor
+  constexpr QuatT() : _w(1), _x(0), _y(0), _z(0) {} // identity quaternion
+  QuatT(const Vec3T<T> &axis, T angle) {
+    Vec3T<T> norm = axis.unit();
+    _w = std::cos(T(0.5) * angle);
+    _x = norm.x() * std::sin(T(0.5) * angle);
+    _y = norm.y() * std::sin(T(0.5) * angle);
+    _z = norm.z() * std::sin(T(0.5) * angle);
+  }
+  constexpr QuatT(T w, T x, T y, T z) : _w(w), _x(x), _y(y), _z(z) {}
+  // precision conversion; implicit only when widening
+  template <typename U>
+  constexpr explicit(sizeof(U) > sizeof(T)) QuatT(const QuatT<U> &q)
+      : _w(q.w()), _x(q.x()), _y(q.y()), _z(q.z()) {}
 
   // getters
-  double w() const {return _w;};
-  double x() const {return _x;};
-  double y() const {return _y;};
-  double z() const {return _z;};
+  constexpr T w() const { return _w; };
+  constexpr T x() const { return _x; };
+  constexpr T y() const { return _y; };
+  constexpr T z() const { return _z; };
 
   // math operations
-  Quaternion inverse() const;
-  Quaternion multiply(const Quaternion &q) const;
-  Quaternion operator*(const Quaternion &q) const;
-  Quaternion conjugate(const Quaternion &q) const;
-  void toAxisAngle(Vec3 &axis, double &angle) const;
-  
-  friend Quaternion euler(const Quaternion &q, const Quaternion &dq, double dt);
+  constexpr QuatT inverse() const { return QuatT(_w, -_x, -_y, -_z); };
+  constexpr QuatT multiply(const QuatT &q) const {
+    return QuatT((_w * q._w) - (_x * q._x) - (_y * q._y) - (_z * q._z),
+                 (_w * q._x) + (_x * q._w) - (_y * q._z) + (_z * q._y),
+                 (_w * q._y) + (_x * q._z) + (_y * q._w) - (_z * q._x),
+                 (_w * q._z) - (_x * q._y) + (_y * q._x) + (_z * q._w));
+  };
+  constexpr QuatT operator*(const QuatT &q) const { return multiply(q); };
+  constexpr QuatT conjugate(const QuatT &q) const {
+    return q * *this * q.inverse();
+  };
+  void toAxisAngle(Vec3T<T> &axis, T &angle) const {
+    T quotient = std::sqrt(_x * _x + _y * _y + _z * _z);
+    axis = quotient < T(EQ_TOLERANCE) ? Vec3T<T>(1, 0, 0)
+                                      : Vec3T<T>(_x, _y, _z) / quotient;
+    angle = T(2) * std::atan2(quotient, _w);
+  };
 
-    void print(std::ostream &out) const;
+  friend QuatT euler(const QuatT &q, const QuatT &dq, T dt) {
+    Vec3T<T> dqAxis;
+    T dqAngle;
+    dq.toAxisAngle(dqAxis, dqAngle);
+    QuatT dqScaled(dqAxis, dqAngle);
+    return q.conjugate(dqScaled);
+  };
+  // spherical interpolation from a (t = 0) to b (t = 1)
+  friend QuatT slerp(const QuatT &a, const QuatT &b, T t) {
+    T cosTheta = a._w * b._w + a._x * b._x + a._y * b._y + a._z * b._z;
+    // q and -q are the same rotation; take the shorter arc
+    T sign = cosTheta < 0 ? -1 : 1;
+    cosTheta *= sign;
+    T wa = 1 - t, wb = t;
+    if (cosTheta < 1 - T(EQ_TOLERANCE)) {
+      T theta = std::acos(cosTheta);
+      wa = std::sin((1 - t) * theta) / std::sin(theta);
+      wb = std::sin(t * theta) / std::sin(theta);
+    }
+    wb *= sign;
+    return QuatT(wa * a._w + wb * b._w, wa * a._x + wb * b._x,
+                 wa * a._y + wb * b._y, wa * a._z + wb * b._z);
+  };
+
+  void print(std::ostream &out) const {
+    out << "(" << w() << "," << x() << "," << y() << "," << z() << ")";
+  };
 
 private:
-  double _w;
-  double _x;
-  double _y;
-  double _z;
+  T _w;
+  T _x;
+  T _y;
+  T _z;
 };
 
-inline std::ostream &operator<<(std::ostream &out, const Quaternion q) {
+typedef QuatT<double> Quaternion;
+typedef QuatT<Real> QuaternionR;
+static_assert(std::is_trivially_copyable_v<Quaternion>);
+static_assert(std::is_trivially_copyable_v<QuaternionR>);
+
+template <typename T>
+inline std::ostream &operator<<(std::ostream &out, const QuatT<T> &q) {
   q.print(out);
   return out;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,10 +1,13 @@
 /* Three-dimensional bouncing ball simulator playground */
 
+#include <algorithm>
 #include <argparse/argparse.hpp>
+#include <atomic>
 #include <chrono>
 #include <cmath>
 #include <iostream>
 #include <mb-libs/mbgfx.h>
+#include <thread>
 
 #include "bbox.h"
 #include "control.h"
@@ -53,6 +56,7 @@ int main(int argc, char *argv[]) {
 
   argparse::ArgumentParser argParser("gravity_sim");
   argParser.add_argument("-c", "--config").default_value("").nargs(1);
+  argParser.add_argument("-l", "--load").default_value("").nargs(1);
   argParser.parse_args(argc, argv);
   simParams = parseXmlConfig(argParser.get<std::string>("--config"));
 
@@ -109,6 +113,10 @@ int main(int argc, char *argv[]) {
                                        GraphicsTools::Colors::White, 32};
   simUtils::ObjMap staticObjs;
   simUtils::ObjMap ballObjs;
+  // ball state reaches rendering and input only through snapshots, and
+  // input changes the environment only through posted commands, so the
+  // environment can step on either thread
+  SnapshotBuffer snapshots;
 
   window.setUserPointer("env", &env);
   window.setUserPointer("phongShader", &phong);
@@ -117,6 +125,7 @@ int main(int argc, char *argv[]) {
   window.setUserPointer("checkMat", &checkerboard);
   window.setUserPointer("woodMat", &woodFloor);
   window.setUserPointer("staticObjMap", &staticObjs);
+  window.setUserPointer("snapshots", &snapshots);
 
   GraphicsTools::RenderObject envBounds;
   envBounds.loadModel(simParams.environment_boundary);
@@ -124,7 +133,7 @@ int main(int argc, char *argv[]) {
                     GraphicsTools::Colors::White, 16});
                     envBounds.setShader(&phong);
   sc.addRenderObject(&envBounds);
-  env.setBounds(&envBounds);
+  env.setBounds(BoundaryCollider(envBounds.vertexData()));
   // simUtils::setupEnvWalls(window);
 
   CursorEmulator cursorEmu(&window);
@@ -165,42 +174,109 @@ int main(int argc, char *argv[]) {
   // deleted
   env.setNextId(window.activeScene()->objs()->size());
 
+  window.setUserPointer("ballObjMap", &ballObjs);
+  window.setUserPointer("ballShader", &stripes);
+
+  // resume from a checkpoint
+  std::string loadFile = argParser.get<std::string>("--load");
+  if (!loadFile.empty() && env.load(loadFile)) {
+    EnvObjSet &objs = env.objs();
+    for (int i = 0; i < objs.size(); ++i) {
+      simUtils::addBallRenderObj(window, objs.id(i), objs.radius[i],
+                                 objs.pos.get(i));
+    }
+    env.setNextId(std::max(env.lastObjId() + 1,
+                           int(window.activeScene()->objs()->size())));
+  }
+  env.writeSnapshot(snapshots.back());
+  snapshots.publish();
+
   glfwSetKeyCallback(window.glfwWindow(), simUtils::keyCallback);
   glfwSetScrollCallback(window.glfwWindow(), simUtils::scrollCallback);
   glfwSetMouseButtonCallback(window.glfwWindow(),
                              simUtils::mouseButtonCallback);
   glfwSetInputMode(window.glfwWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-  window.setUserPointer("ballObjMap", &ballObjs);
   window.setUserPointer("ctrlSet", &ctrlSet);
-  window.setUserPointer("ballShader", &stripes);
   window.setUserPointer("cam", &cam);
   window.setUserPointer("cursorEmu", &cursorEmu);
   window.setUserPointer("cursorEmuObjId", &cursorEmuObjId);
   window.setUserPointer("userCursor", &uc);
   window.setUserPointer("font", &font);
 
-  // timing vars
-  double tLastWindow = 0;
-  double tLastEnv = 0;
-  double tLastPrint = 0;
-
-  while (!window.shouldClose()) {
+  // fixed-step scheduler: elapsed wall time (ms) feeds an accumulator that
+  // is drained in whole environment steps; rendering interpolates between
+  // the last two steps
+  double envDt = 1000.0 / simParams.environment_frameRate;
+  double windowDt = 1000.0 / simParams.visualization_frameRate;
+  auto stepEnv = [&](double &accumulator, double &tLastStep) {
     double tNow = simUtils::computeTNow();
-
-    if ((tNow - tLastEnv) / 1000.0 > (1.0 / simParams.environment_frameRate)) {
+    accumulator += tNow - tLastStep;
+    tLastStep = tNow;
+    // a long stall (window drag, debugger) is dropped rather than replayed
+    accumulator = std::min(accumulator, 1000.0);
+
+    int substeps = std::min(int(accumulator / envDt),
+                            simParams.environment_maxSubsteps);
+    for (int i = 0; i < substeps; ++i) {
+      if (i == substeps - 1) {
+        env.storePrevState();
+      }
       env.update();
-      tLastEnv = tNow;
-
-      // only update window at framerate
-      if ((tNow - tLastWindow) / 1000.0 >
-          (1.0 / simParams.visualization_frameRate)) {
-        cursorEmu.update();
-        simUtils::handleUserInput(window);
-        simUtils::drawSim(window);
-        tLastWindow = tNow;
+      accumulator -= envDt;
+    }
+    if (substeps > 0) {
+      env.writeSnapshot(snapshots.back());
+      snapshots.back().tStep = simUtils::computeTNow();
+      snapshots.publish();
+    }
+  };
+
+  std::atomic<bool> stepping(true);
+  std::thread stepThread;
+  if (simParams.environment_stepThread) {
+    stepThread = std::thread([&] {
+      double accumulator = 0;
+      double tLastStep = simUtils::computeTNow();
+      while (stepping) {
+        stepEnv(accumulator, tLastStep);
+        std::this_thread::sleep_for(
+            std::chrono::duration<double, std::milli>(envDt - accumulator));
       }
+    });
+  }
+
+  double accumulator = 0;
+  double tLastStep = simUtils::computeTNow();
+  while (!window.shouldClose()) {
+    double tFrame = simUtils::computeTNow();
+    double alpha;
+    if (stepThread.joinable()) {
+      snapshots.acquire();
+      // the stepping thread publishes every envDt, so interpolate across
+      // the time since the last step finished
+      alpha = std::clamp((tFrame - snapshots.front().tStep) / envDt, 0.0, 1.0);
+    } else {
+      stepEnv(accumulator, tLastStep);
+      snapshots.acquire();
+      alpha = std::min(accumulator / envDt, 1.0);
     }
+
+    cursorEmu.update();
+    simUtils::handleUserInput(window);
+    simUtils::drawSim(window, alpha);
+
+    // sleep out the rest of the frame instead of spinning
+    double tWait = tFrame + windowDt - simUtils::computeTNow();
+    if (tWait > 0) {
+      std::this_thread::sleep_for(
+          std::chrono::duration<double, std::milli>(tWait));
+    }
+  }
+
+  stepping = false;
+  if (stepThread.joinable()) {
+    stepThread.join();
   }
 
   GraphicsTools::CloseGraphics();
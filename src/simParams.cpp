@@ -61,6 +61,22 @@ SimParameters parseXmlConfig(std::string fileName) {
                          "height"));
   result.environment_frameRate =
       getAttributeDouble(&paramsXml, {"environment", "frameRate"}, "value");
+  result.environment_maxSubsteps =
+      getAttributeInt(&paramsXml, {"environment", "maxSubsteps"}, "value");
+  result.environment_stepThread =
+      getAttributeBool(&paramsXml, {"environment", "stepThread"}, "value");
+  result.environment_adaptiveStep =
+      getAttributeBool(&paramsXml, {"environment", "adaptiveStep"}, "value");
+  result.environment_minStep =
+      getAttributeDouble(&paramsXml, {"environment", "minStep"}, "value");
+  result.environment_maxStep =
+      getAttributeDouble(&paramsXml, {"environment", "maxStep"}, "value");
+  result.environment_stepCourant =
+      getAttributeDouble(&paramsXml, {"environment", "stepCourant"}, "value");
+  result.environment_stepStiffness = getAttributeDouble(
+      &paramsXml, {"environment", "stepStiffness"}, "value");
+  result.environment_maxPenetration = getAttributeDouble(
+      &paramsXml, {"environment", "maxPenetration"}, "value");
   result.environment_unitsPerMeter =
       getAttributeDouble(&paramsXml, {"environment", "unitsPerMeter"}, "value");
   result.environment_paused =
@@ -77,6 +93,48 @@ SimParameters parseXmlConfig(std::string fileName) {
            getAttributeDouble(&paramsXml, {"environment", "wind"}, "z"));
   result.environment_airDensity =
       getAttributeDouble(&paramsXml, {"environment", "airDensity"}, "value");
+  result.environment_mutualGravity =
+      getAttributeBool(&paramsXml, {"environment", "mutualGravity"}, "value");
+  result.environment_gravityConstant = getAttributeDouble(
+      &paramsXml, {"environment", "gravityConstant"}, "value");
+  result.environment_openingAngle =
+      getAttributeDouble(&paramsXml, {"environment", "openingAngle"}, "value");
+  result.environment_softening =
+      getAttributeDouble(&paramsXml, {"environment", "softening"}, "value");
+  result.environment_gravityDirect =
+      getAttributeBool(&paramsXml, {"environment", "gravityDirect"}, "value");
+  result.environment_blockSteps =
+      getAttributeBool(&paramsXml, {"environment", "blockSteps"}, "value");
+  result.environment_blockLevels =
+      getAttributeInt(&paramsXml, {"environment", "blockLevels"}, "value");
+  result.environment_blockAccuracy = getAttributeDouble(
+      &paramsXml, {"environment", "blockAccuracy"}, "value");
+  result.environment_engine =
+      getAttributeInt(&paramsXml, {"environment", "engine"}, "value");
+  result.environment_broadphase =
+      getAttributeInt(&paramsXml, {"environment", "broadphase"}, "value");
+  result.environment_neighborLists =
+      getAttributeBool(&paramsXml, {"environment", "neighborLists"}, "value");
+  result.environment_neighborSkin =
+      getAttributeDouble(&paramsXml, {"environment", "neighborSkin"}, "value");
+  result.environment_reorderInterval = getAttributeInt(
+      &paramsXml, {"environment", "reorderInterval"}, "value");
+  result.environment_integrator =
+      getAttributeInt(&paramsXml, {"environment", "integrator"}, "value");
+  result.environment_contacts =
+      getAttributeInt(&paramsXml, {"environment", "contacts"}, "value");
+  result.environment_ccd =
+      getAttributeBool(&paramsXml, {"environment", "ccd"}, "value");
+  result.environment_ccdMotion =
+      getAttributeDouble(&paramsXml, {"environment", "ccdMotion"}, "value");
+  result.environment_threads =
+      getAttributeInt(&paramsXml, {"environment", "threads"}, "value");
+  result.environment_snapshot =
+      getAttributeString(&paramsXml, {"environment", "snapshot"}, "path");
+  result.environment_profileFile =
+      getAttributeString(&paramsXml, {"environment", "profileFile"}, "path");
+  result.environment_profileInterval = getAttributeDouble(
+      &paramsXml, {"environment", "profileInterval"}, "value");
   result.controls_disableUserInput =
       getAttributeBool(&paramsXml, {"controls", "disableUserInput"}, "value");
   result.controls_fullscreenMode =
@@ -134,6 +192,20 @@ SimParameters parseXmlConfig(std::string fileName) {
       getAttributeDouble(&paramsXml, {"tuning", "objSpringDamping"}, "value");
   result.tuning_objFrictionCoeff =
       getAttributeDouble(&paramsXml, {"tuning", "objFrictionCoeff"}, "value");
+  result.tuning_sleepSpeed =
+      getAttributeDouble(&paramsXml, {"tuning", "sleepSpeed"}, "value");
+  result.tuning_sleepSpin =
+      getAttributeDouble(&paramsXml, {"tuning", "sleepSpin"}, "value");
+  result.tuning_sleepTime =
+      getAttributeDouble(&paramsXml, {"tuning", "sleepTime"}, "value");
+  result.tuning_elasticity =
+      getAttributeDouble(&paramsXml, {"tuning", "elasticity"}, "value");
+  result.tuning_solverIterations =
+      getAttributeInt(&paramsXml, {"tuning", "solverIterations"}, "value");
+  result.tuning_penetrationSlop =
+      getAttributeDouble(&paramsXml, {"tuning", "penetrationSlop"}, "value");
+  result.tuning_penetrationCorrection = getAttributeDouble(
+      &paramsXml, {"tuning", "penetrationCorrection"}, "value");
   result.input_forward =
       getAttributeInt(&paramsXml, {"input", "forward"}, "value");
   result.input_backward =
@@ -159,5 +231,8 @@ SimParameters parseXmlConfig(std::string fileName) {
   result.input_clearEnv =
       getAttributeInt(&paramsXml, {"input", "clearEnv"}, "value");
   result.input_pause = getAttributeInt(&paramsXml, {"input", "pause"}, "value");
+  result.input_save = getAttributeInt(&paramsXml, {"input", "save"}, "value");
+  result.input_profile =
+      getAttributeInt(&paramsXml, {"input", "profile"}, "value");
   return result;
 }
@@ -10,12 +10,41 @@ struct SimParameters {
   double visualization_frameRate;
   Vec3 visualization_dimensions;
   double environment_frameRate;
+  int environment_maxSubsteps;
+  bool environment_stepThread;
+  bool environment_adaptiveStep;
+  double environment_minStep;
+  double environment_maxStep;
+  double environment_stepCourant;
+  double environment_stepStiffness;
+  double environment_maxPenetration;
   double environment_unitsPerMeter;
   bool environment_paused;
   std::string environment_boundary;
   Vec3 environment_gravity;
   Vec3 environment_wind;
   double environment_airDensity;
+  bool environment_mutualGravity;
+  double environment_gravityConstant;
+  double environment_openingAngle;
+  double environment_softening;
+  bool environment_gravityDirect;
+  bool environment_blockSteps;
+  int environment_blockLevels;
+  double environment_blockAccuracy;
+  int environment_engine;
+  int environment_broadphase;
+  bool environment_neighborLists;
+  double environment_neighborSkin;
+  int environment_reorderInterval;
+  int environment_integrator;
+  int environment_contacts;
+  bool environment_ccd;
+  double environment_ccdMotion;
+  int environment_threads;
+  std::string environment_snapshot;
+  std::string environment_profileFile;
+  double environment_profileInterval;
   bool controls_disableUserInput;
   bool controls_fullscreenMode;
   std::vector<double> controls_radius;
@@ -30,6 +59,13 @@ struct SimParameters {
   double tuning_objSpringCoeff;
   double tuning_objSpringDamping;
   double tuning_objFrictionCoeff;
+  double tuning_sleepSpeed;
+  double tuning_sleepSpin;
+  double tuning_sleepTime;
+  double tuning_elasticity;
+  int tuning_solverIterations;
+  double tuning_penetrationSlop;
+  double tuning_penetrationCorrection;
   int input_forward;
   int input_backward;
   int input_right;
@@ -45,18 +81,49 @@ struct SimParameters {
   int input_toolReset;
   int input_clearEnv;
   int input_pause;
+  int input_save;
+  int input_profile;
 };
 
 const SimParameters defaultParams = {
     60,
     Vec3(1024, 768),
     500,
+    25,
+    false,
+    false,
+    1e-4,
+    0.02,
+    0.25,
+    0.3,
+    0.5,
     4,
     false,
     "assets/cube.obj",
     Vec3(0, -9.8, 0),
     Vec3(0, 0, 0),
     0.005,
+    false,
+    1,
+    0.5,
+    0.05,
+    false,
+    false,
+    8,
+    0.03,
+    0,
+    1,
+    false,
+    0.1,
+    0,
+    0,
+    0,
+    false,
+    0.5,
+    1,
+    "snapshot.gsim",
+    "profile.txt",
+    0,
     true,
     true,
     {0.2, 0.5, 1e-2, 0.3},
@@ -71,6 +138,13 @@ const SimParameters defaultParams = {
     1e4,
     1e1,
     2.5e-2,
+    0.2,
+    2,
+    0.5,
+    0.5,
+    10,
+    0.01,
+    0.2,
     87,
     88,
     67,
@@ -86,6 +160,8 @@ const SimParameters defaultParams = {
     48,
     75,
     32,
+    294,
+    291,
 };
 
 SimParameters parseXmlConfig(std::string fileName);
@@ -0,0 +1,171 @@
+/* Minimal packs of doubles and floats for the batched force kernels. PackD
+    and PackF use the widest vector unit the build targets (AVX: 4 doubles or
+    8 floats, SSE2: 2 or 4, otherwise 1); ScalarD and ScalarF are the 1-lane
+    fallbacks used for loop tails. All have the same interface, so a kernel
+    written as a template over the pack type compiles for any of them. Lanes
+    are never fused (no FMA, and the Makefile builds with -ffp-contract=off
+    so the compiler doesn't fuse them either), so a lane rounds exactly as
+    the scalar pack does. PackR and ScalarR match Real (vec3d.h). */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+template <typename T> struct ScalarPack {
+  static const int N = 1;
+  T v;
+
+  ScalarPack() : v(0) {};
+  ScalarPack(T d) : v(d) {};
+  static ScalarPack load(const T *p) { return ScalarPack(*p); };
+  void store(T *p) const { *p = v; };
+
+  friend ScalarPack operator+(ScalarPack a, ScalarPack b) { return a.v + b.v; };
+  friend ScalarPack operator-(ScalarPack a, ScalarPack b) { return a.v - b.v; };
+  friend ScalarPack operator*(ScalarPack a, ScalarPack b) { return a.v * b.v; };
+  friend ScalarPack operator/(ScalarPack a, ScalarPack b) { return a.v / b.v; };
+  friend ScalarPack operator-(ScalarPack a) { return -a.v; };
+  friend ScalarPack sqrt(ScalarPack a) { return std::sqrt(a.v); };
+  // x where a >= b, zero elsewhere
+  friend ScalarPack ifGe(ScalarPack a, ScalarPack b, ScalarPack x) {
+    return a.v >= b.v ? x.v : T(0);
+  };
+  // x where a < b, zero elsewhere
+  friend ScalarPack ifLt(ScalarPack a, ScalarPack b, ScalarPack x) {
+    return a.v < b.v ? x.v : T(0);
+  };
+};
+typedef ScalarPack<double> ScalarD;
+typedef ScalarPack<float> ScalarF;
+
+#if defined(__AVX__)
+
+struct PackD {
+  static const int N = 4;
+  __m256d v;
+
+  PackD() : v(_mm256_setzero_pd()) {};
+  PackD(double d) : v(_mm256_set1_pd(d)) {};
+  PackD(__m256d m) : v(m) {};
+  static PackD load(const double *p) { return _mm256_loadu_pd(p); };
+  void store(double *p) const { _mm256_storeu_pd(p, v); };
+
+  friend PackD operator+(PackD a, PackD b) { return _mm256_add_pd(a.v, b.v); };
+  friend PackD operator-(PackD a, PackD b) { return _mm256_sub_pd(a.v, b.v); };
+  friend PackD operator*(PackD a, PackD b) { return _mm256_mul_pd(a.v, b.v); };
+  friend PackD operator/(PackD a, PackD b) { return _mm256_div_pd(a.v, b.v); };
+  friend PackD operator-(PackD a) {
+    return _mm256_xor_pd(a.v, _mm256_set1_pd(-0.0));
+  };
+  friend PackD sqrt(PackD a) { return _mm256_sqrt_pd(a.v); };
+  friend PackD ifGe(PackD a, PackD b, PackD x) {
+    return _mm256_and_pd(_mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ), x.v);
+  };
+  friend PackD ifLt(PackD a, PackD b, PackD x) {
+    return _mm256_and_pd(_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ), x.v);
+  };
+};
+
+struct PackF {
+  static const int N = 8;
+  __m256 v;
+
+  PackF() : v(_mm256_setzero_ps()) {};
+  PackF(float d) : v(_mm256_set1_ps(d)) {};
+  PackF(__m256 m) : v(m) {};
+  static PackF load(const float *p) { return _mm256_loadu_ps(p); };
+  void store(float *p) const { _mm256_storeu_ps(p, v); };
+
+  friend PackF operator+(PackF a, PackF b) { return _mm256_add_ps(a.v, b.v); };
+  friend PackF operator-(PackF a, PackF b) { return _mm256_sub_ps(a.v, b.v); };
+  friend PackF operator*(PackF a, PackF b) { return _mm256_mul_ps(a.v, b.v); };
+  friend PackF operator/(PackF a, PackF b) { return _mm256_div_ps(a.v, b.v); };
+  friend PackF operator-(PackF a) {
+    return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f));
+  };
+  friend PackF sqrt(PackF a) { return _mm256_sqrt_ps(a.v); };
+  friend PackF ifGe(PackF a, PackF b, PackF x) {
+    return _mm256_and_ps(_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ), x.v);
+  };
+  friend PackF ifLt(PackF a, PackF b, PackF x) {
+    return _mm256_and_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ), x.v);
+  };
+};
+
+#elif defined(__SSE2__)
+
+struct PackD {
+  static const int N = 2;
+  __m128d v;
+
+  PackD() : v(_mm_setzero_pd()) {};
+  PackD(double d) : v(_mm_set1_pd(d)) {};
+  PackD(__m128d m) : v(m) {};
+  static PackD load(const double *p) { return _mm_loadu_pd(p); };
+  void store(double *p) const { _mm_storeu_pd(p, v); };
+
+  friend PackD operator+(PackD a, PackD b) { return _mm_add_pd(a.v, b.v); };
+  friend PackD operator-(PackD a, PackD b) { return _mm_sub_pd(a.v, b.v); };
+  friend PackD operator*(PackD a, PackD b) { return _mm_mul_pd(a.v, b.v); };
+  friend PackD operator/(PackD a, PackD b) { return _mm_div_pd(a.v, b.v); };
+  friend PackD operator-(PackD a) {
+    return _mm_xor_pd(a.v, _mm_set1_pd(-0.0));
+  };
+  friend PackD sqrt(PackD a) { return _mm_sqrt_pd(a.v); };
+  friend PackD ifGe(PackD a, PackD b, PackD x) {
+    return _mm_and_pd(_mm_cmpge_pd(a.v, b.v), x.v);
+  };
+  friend PackD ifLt(PackD a, PackD b, PackD x) {
+    return _mm_and_pd(_mm_cmplt_pd(a.v, b.v), x.v);
+  };
+};
+
+struct PackF {
+  static const int N = 4;
+  __m128 v;
+
+  PackF() : v(_mm_setzero_ps()) {};
+  PackF(float d) : v(_mm_set1_ps(d)) {};
+  PackF(__m128 m) : v(m) {};
+  static PackF load(const float *p) { return _mm_loadu_ps(p); };
+  void store(float *p) const { _mm_storeu_ps(p, v); };
+
+  friend PackF operator+(PackF a, PackF b) { return _mm_add_ps(a.v, b.v); };
+  friend PackF operator-(PackF a, PackF b) { return _mm_sub_ps(a.v, b.v); };
+  friend PackF operator*(PackF a, PackF b) { return _mm_mul_ps(a.v, b.v); };
+  friend PackF operator/(PackF a, PackF b) { return _mm_div_ps(a.v, b.v); };
+  friend PackF operator-(PackF a) {
+    return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f));
+  };
+  friend PackF sqrt(PackF a) { return _mm_sqrt_ps(a.v); };
+  friend PackF ifGe(PackF a, PackF b, PackF x) {
+    return _mm_and_ps(_mm_cmpge_ps(a.v, b.v), x.v);
+  };
+  friend PackF ifLt(PackF a, PackF b, PackF x) {
+    return _mm_and_ps(_mm_cmplt_ps(a.v, b.v), x.v);
+  };
+};
+
+#else
+
+typedef ScalarD PackD;
+typedef ScalarF PackF;
+
+#endif
+
+#ifdef SINGLE_PRECISION
+typedef PackF PackR;
+typedef ScalarF ScalarR;
+#else
+typedef PackD PackR;
+typedef ScalarD ScalarR;
+#endif
+
+#endif
@@ -0,0 +1,132 @@
+#include "sweepPrune.h"
+
+#include <algorithm>
+
+void SweepAndPrune::update(const Vec3Array &positions,
+                           const std::vector<Real> &radii, Real scale,
+                           Real margin) {
+  int n = positions.size();
+  for (int axis = 0; axis < 3; ++axis) {
+    _lo[axis].resize(n);
+    _hi[axis].resize(n);
+  }
+  for (int i = 0; i < n; ++i) {
+    Real c[3] = {positions.x[i], positions.y[i], positions.z[i]};
+    Real half = scale * radii[i] + margin;
+    for (int axis = 0; axis < 3; ++axis) {
+      _lo[axis][i] = c[axis] - half;
+      _hi[axis][i] = c[axis] + half;
+    }
+  }
+  if (!_valid || n != size()) {
+    rebuild(n);
+    return;
+  }
+  for (int axis = 0; axis < 3; ++axis) {
+    std::vector<Endpoint> &list = _axes[axis];
+    for (Endpoint &e : list) {
+      e.value = e.end ? _hi[axis][e.ball] : _lo[axis][e.ball];
+    }
+    int other1 = (axis + 1) % 3, other2 = (axis + 2) % 3;
+    for (int k = 1; k < int(list.size()); ++k) {
+      Endpoint e = list[k];
+      int m = k;
+      for (; m > 0 && list[m - 1] > e; --m) {
+        const Endpoint &prev = list[m - 1];
+        if (!e.end && prev.end) {
+          // e's ball now starts before prev's ends: overlap on this axis
+          if (overlaps(e.ball, prev.ball, other1) &&
+              overlaps(e.ball, prev.ball, other2)) {
+            addPair(e.ball, prev.ball);
+          }
+        } else if (e.end && !prev.end) {
+          removePair(e.ball, prev.ball);
+        }
+        list[m] = prev;
+        _swaps++;
+      }
+      list[m] = e;
+    }
+  }
+}
+
+void SweepAndPrune::permute(const std::vector<int> &order) {
+  int n = order.size();
+  if (!_valid || n != size()) {
+    _valid = false;
+    return;
+  }
+  std::vector<int> slot(n); // old slot -> new slot
+  for (int k = 0; k < n; ++k) {
+    slot[order[k]] = k;
+  }
+  for (int axis = 0; axis < 3; ++axis) {
+    for (Endpoint &e : _axes[axis]) {
+      e.ball = slot[e.ball];
+    }
+  }
+  std::vector<std::vector<int>> near(n);
+  for (int k = 0; k < n; ++k) {
+    near[k].swap(_near[order[k]]);
+    for (int &j : near[k]) {
+      j = slot[j];
+    }
+    std::sort(near[k].begin(), near[k].end());
+  }
+  _near.swap(near);
+}
+
+void SweepAndPrune::rebuild(int n) {
+  _near.assign(n, {});
+  for (int axis = 0; axis < 3; ++axis) {
+    std::vector<Endpoint> &list = _axes[axis];
+    list.clear();
+    for (int i = 0; i < n; ++i) {
+      list.push_back({_lo[axis][i], i, false});
+      list.push_back({_hi[axis][i], i, true});
+    }
+    std::sort(list.begin(), list.end(),
+              [](const Endpoint &a, const Endpoint &b) { return b > a; });
+  }
+  // one sweep along x, testing each box against the ones still open
+  std::vector<int> open;
+  for (const Endpoint &e : _axes[0]) {
+    if (e.end) {
+      open.erase(std::find(open.begin(), open.end(), e.ball));
+      continue;
+    }
+    for (int other : open) {
+      if (overlaps(e.ball, other, 1) && overlaps(e.ball, other, 2)) {
+        addPair(e.ball, other);
+      }
+    }
+    open.push_back(e.ball);
+  }
+  _valid = true;
+}
+
+bool SweepAndPrune::overlaps(int a, int b, int axis) const {
+  return _lo[axis][a] <= _hi[axis][b] && _lo[axis][b] <= _hi[axis][a];
+}
+
+void SweepAndPrune::addPair(int a, int b) {
+  auto insert = [](std::vector<int> &list, int j) {
+    auto at = std::lower_bound(list.begin(), list.end(), j);
+    if (at == list.end() || *at != j) {
+      list.insert(at, j);
+    }
+  };
+  insert(_near[a], b);
+  insert(_near[b], a);
+}
+
+void SweepAndPrune::removePair(int a, int b) {
+  auto erase = [](std::vector<int> &list, int j) {
+    auto at = std::lower_bound(list.begin(), list.end(), j);
+    if (at != list.end() && *at == j) {
+      list.erase(at);
+    }
+  };
+  erase(_near[a], b);
+  erase(_near[b], a);
+}
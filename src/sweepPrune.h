@@ -0,0 +1,65 @@
+/* Sweep-and-prune broadphase. Each ball's bounding box is kept as two
+    endpoints on each of the three axes, in one sorted list per axis. Balls
+    move little between steps, so the lists are nearly sorted already and
+    an insertion sort brings them up to date in close to linear time. Every
+    swap of a start point with another ball's end point is a pair of balls
+    starting or ending overlap on that axis; pairs whose boxes then overlap
+    on all three axes are kept as each ball's candidate list, so pairs are
+    found incrementally instead of from scratch every step. Unlike the
+    uniform grid, nothing depends on the largest ball size, so scenes with
+    very mixed radii cost no extra. */
+
+#ifndef SWEEP_PRUNE_H
+#define SWEEP_PRUNE_H
+
+#include <vector>
+
+#include "vec3d.h"
+
+class SweepAndPrune {
+public:
+  int size() const { return _near.size(); };
+  // bring the lists up to date with the current ball boxes, scale times
+  // the radius plus margin in each direction; starts over when the number
+  // of balls changed or after invalidate()
+  void update(const Vec3Array &positions, const std::vector<Real> &radii,
+              Real scale = 1, Real margin = 0);
+  // start over at the next update, e.g. after balls were replaced in
+  // their slots; the lists only follow balls that move
+  void invalidate() { _valid = false; };
+  // follow a BallStore::permute(order) of the balls, keeping the sorted
+  // lists; starts over at the next update if the sizes differ
+  void permute(const std::vector<int> &order);
+
+  // call f(j) for every ball j whose box overlaps ball i's, in slot order
+  template <typename F> void forEachNear(int i, F f) const {
+    for (int j : _near[i]) {
+      f(j);
+    }
+  };
+  long swaps() const { return _swaps; }; // insertion sort moves, in total
+
+private:
+  struct Endpoint {
+    Real value;
+    int ball;
+    bool end; // start points sort before end points of equal value
+    bool operator>(const Endpoint &o) const {
+      return value > o.value || (value == o.value && end && !o.end);
+    };
+  };
+
+  void rebuild(int n);
+  // whether the boxes of balls a and b overlap along the axis
+  bool overlaps(int a, int b, int axis) const;
+  void addPair(int a, int b);
+  void removePair(int a, int b);
+
+  std::vector<Endpoint> _axes[3];
+  std::vector<Real> _lo[3], _hi[3];  // per ball box
+  std::vector<std::vector<int>> _near; // per ball, sorted
+  bool _valid = false;
+  long _swaps = 0;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(int threads)
+    : _job(nullptr), _jobSize(0), _generation(0), _pending(0), _stop(false) {
+  for (int i = 1; i < threads; ++i) {
+    _workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _start.notify_all();
+  for (std::thread &t : _workers) {
+    t.join();
+  }
+}
+
+void ThreadPool::runChunk(int chunk) {
+  int begin = long(_jobSize) * chunk / size();
+  int end = long(_jobSize) * (chunk + 1) / size();
+  if (begin < end) {
+    (*_job)(begin, end, chunk);
+  }
+}
+
+void ThreadPool::parallelFor(int n,
+                             const std::function<void(int, int, int)> &f) {
+  if (_workers.empty()) {
+    f(0, n, 0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _job = &f;
+    _jobSize = n;
+    _pending = _workers.size();
+    _generation++;
+  }
+  _start.notify_all();
+  runChunk(0);
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [this] { return _pending == 0; });
+  _job = nullptr;
+}
+
+void ThreadPool::workerLoop(int chunk) {
+  int seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _start.wait(lock, [&] { return _stop || _generation != seen; });
+      if (_stop) {
+        return;
+      }
+      seen = _generation;
+    }
+    runChunk(chunk);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending--;
+    }
+    _done.notify_one();
+  }
+}
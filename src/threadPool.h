@@ -0,0 +1,41 @@
+/* A fixed set of worker threads for splitting loops across cores. Work is
+    always cut into the same contiguous chunks for a given pool size, so
+    results don't depend on thread scheduling. */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+  // threads includes the calling thread, which also runs a chunk
+  ThreadPool(int threads);
+  ~ThreadPool();
+
+  int size() const { return _workers.size() + 1; };
+
+  // call f(begin, end, chunk) on size() contiguous chunks of [0, n) and
+  // wait for all of them
+  void parallelFor(int n, const std::function<void(int, int, int)> &f);
+
+private:
+  void workerLoop(int chunk);
+  void runChunk(int chunk);
+
+  std::vector<std::thread> _workers;
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  const std::function<void(int, int, int)> *_job;
+  int _jobSize;
+  int _generation; // incremented for every job
+  int _pending;    // chunks still running
+  bool _stop;
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "uniformGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+UniformGrid::UniformGrid() : _cellSize(1), _bucketMask(0) {
+  _bucketStart.assign(2, 0);
+}
+
+// cell coordinates beyond this (and NaNs) are clamped, so a diverged ball
+// can't overflow the int cast; neighbor offsets still fit in an int
+static const double CELL_LIMIT = 1 << 30;
+
+static int clampCell(double c) {
+  return int(c > -CELL_LIMIT ? std::min(c, CELL_LIMIT) : -CELL_LIMIT);
+}
+
+UniformGrid::Cell UniformGrid::cellAt(const Vec3 &pos) const {
+  return {clampCell(std::floor(pos.x() / _cellSize)),
+          clampCell(std::floor(pos.y() / _cellSize)),
+          clampCell(std::floor(pos.z() / _cellSize))};
+}
+
+unsigned int UniformGrid::bucketOf(const Cell &c) const {
+  return ((unsigned int)c.x * 73856093u ^ (unsigned int)c.y * 19349663u ^
+          (unsigned int)c.z * 83492791u) &
+         _bucketMask;
+}
+
+void UniformGrid::build(const Vec3Array &positions, double cellSize) {
+  _cellSize = cellSize;
+  // about two buckets per object keeps hash collisions rare
+  int buckets = 64;
+  while (buckets < 2 * positions.size()) {
+    buckets <<= 1;
+  }
+  _bucketMask = buckets - 1;
+
+  _cells.resize(positions.size());
+  _entries.resize(positions.size());
+  _bucketStart.assign(buckets + 1, 0);
+
+  // counting sort of objects by bucket; after the prefix sum each start
+  // holds the end of its bucket and is walked back while filling
+  for (int i = 0; i < positions.size(); ++i) {
+    _cells[i] = cellAt(positions.get(i));
+    _bucketStart[bucketOf(_cells[i])]++;
+  }
+  for (int b = 1; b <= buckets; ++b) {
+    _bucketStart[b] += _bucketStart[b - 1];
+  }
+  for (int i = positions.size() - 1; i >= 0; --i) {
+    _entries[--_bucketStart[bucketOf(_cells[i])]] = i;
+  }
+}
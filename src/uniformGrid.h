@@ -0,0 +1,107 @@
+/* Uniform grid broadphase. Objects are bucketed by the cell containing their
+    center; collision candidates for an object are the objects in its own
+    cell and the 26 cells around it. */
+
+#ifndef UNIFORM_GRID_H
+#define UNIFORM_GRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "vec3d.h"
+
+class UniformGrid {
+public:
+  UniformGrid();
+
+  double cellSize() const { return _cellSize; };
+  int size() const { return _cells.size(); };
+
+  // rebuild from object centers; cellSize should be at least the largest
+  // possible distance between two colliding centers
+  void build(const Vec3Array &positions, double cellSize);
+
+  // call f(j) for every object j in the cells around object i (i included)
+  template <typename F> void forEachNear(int i, F f) const;
+  // call f(j) for every object j whose cell overlaps the box [lo, hi];
+  // boxes spanning more cells than there are objects scan all objects
+  template <typename F>
+  void forEachInBox(const Vec3 &lo, const Vec3 &hi, F f) const;
+
+private:
+  struct Cell {
+    int x, y, z;
+    bool operator==(const Cell &c) const {
+      return x == c.x && y == c.y && z == c.z;
+    };
+  };
+  Cell cellAt(const Vec3 &pos) const;
+  unsigned int bucketOf(const Cell &c) const;
+
+  double _cellSize;
+  unsigned int _bucketMask;
+  std::vector<Cell> _cells;           // cell of each object
+  std::vector<int> _bucketStart;      // offsets into _entries per bucket
+  std::vector<int> _entries;          // object indices sorted by bucket
+};
+
+template <typename F> void UniformGrid::forEachNear(int i, F f) const {
+  const Cell &home = _cells[i];
+  for (int dz = -1; dz <= 1; ++dz) {
+    for (int dy = -1; dy <= 1; ++dy) {
+      for (int dx = -1; dx <= 1; ++dx) {
+        Cell c = {home.x + dx, home.y + dy, home.z + dz};
+        unsigned int b = bucketOf(c);
+        for (int k = _bucketStart[b]; k < _bucketStart[b + 1]; ++k) {
+          // different cells can share a bucket; only take objects that
+          // really are in this cell so no pair is visited twice
+          if (_cells[_entries[k]] == c) {
+            f(_entries[k]);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename F>
+void UniformGrid::forEachInBox(const Vec3 &lo, const Vec3 &hi, F f) const {
+  // count the cells in double from the unclamped bounds; a box that is
+  // huge or not finite scans all objects instead
+  double cells = 1;
+  for (double span : {std::floor(hi.x() / _cellSize) -
+                          std::floor(lo.x() / _cellSize) + 1,
+                      std::floor(hi.y() / _cellSize) -
+                          std::floor(lo.y() / _cellSize) + 1,
+                      std::floor(hi.z() / _cellSize) -
+                          std::floor(lo.z() / _cellSize) + 1}) {
+    cells *= std::max(span, 0.0);
+  }
+  Cell a = cellAt(lo), b = cellAt(hi);
+  if (!(cells <= double(_cells.size()))) {
+    for (int j = 0; j < int(_cells.size()); ++j) {
+      const Cell &c = _cells[j];
+      if (c.x >= a.x && c.x <= b.x && c.y >= a.y && c.y <= b.y &&
+          c.z >= a.z && c.z <= b.z) {
+        f(j);
+      }
+    }
+    return;
+  }
+  for (int z = a.z; z <= b.z; ++z) {
+    for (int y = a.y; y <= b.y; ++y) {
+      for (int x = a.x; x <= b.x; ++x) {
+        Cell c = {x, y, z};
+        unsigned int bucket = bucketOf(c);
+        for (int k = _bucketStart[bucket]; k < _bucketStart[bucket + 1]; ++k) {
+          if (_cells[_entries[k]] == c) {
+            f(_entries[k]);
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include "bbox.h"
 #include "control.h"
 #include "env3d.h"
+#include "profiler.h"
 
 #include <chrono>
 #include <format>
@@ -11,9 +12,13 @@
 
 namespace simUtils {
 
+const EnvSnapshot &envSnapshot(GraphicsTools::WindowBase &win) {
+  return static_cast<SnapshotBuffer *>(win.userPointer("snapshots"))->front();
+}
+
 double computeTNow() {
   using namespace std::chrono;
-  return duration_cast<milliseconds>(system_clock::now().time_since_epoch())
+  return duration<double, std::milli>(steady_clock::now().time_since_epoch())
       .count();
 }
 
@@ -36,42 +41,49 @@ void createObj(GraphicsTools::Window &win, Vec3 candidateObjPos,
                Vec3 candidateObjVel) {
   Environment *env = static_cast<Environment *>(win.userPointer("env"));
   ControlSet *ctrls = static_cast<ControlSet *>(win.userPointer("ctrlSet"));
-  simUtils::ObjMap *objMap =
-      static_cast<simUtils::ObjMap *>(win.userPointer("ballObjMap"));
-  GraphicsTools::ShaderProgram *shader =
-      static_cast<GraphicsTools::ShaderProgram *>(
-          win.userPointer("ballShader"));
-  if (objIdAtEnvPos(candidateObjPos, *env,
+  if (objIdAtEnvPos(candidateObjPos, envSnapshot(win),
                     (*ctrls)["radius"] * 2.0 *
                         simParams.environment_unitsPerMeter) == -1 &&
       env->computeOutsideEnv(candidateObjPos,
                              (*ctrls)["radius"] * 2.0 *
                                  simParams.environment_unitsPerMeter)
               .mag() <= 0) {
-    env->addObj(
-        Ball(BBox(candidateObjPos, (*ctrls)["radius"] * 2.0 *
+    Ball obj(BBox(candidateObjPos, (*ctrls)["radius"] * 2.0 *
                                        simParams.environment_unitsPerMeter),
              pow((*ctrls)["radius"] * simParams.environment_unitsPerMeter, 3),
              candidateObjPos,
-             candidateObjVel * simParams.environment_unitsPerMeter, 1,
+             candidateObjVel * simParams.environment_unitsPerMeter,
+             simParams.tuning_elasticity,
              (*ctrls)["vela"] * Vec3((*ctrls)["angularAxisX"],
                                      (*ctrls)["angularAxisY"],
-                                     (*ctrls)["angularAxisZ"])));
-    GraphicsTools::Material mat = {GraphicsTools::randomColor(), NULL,
-                                   0.5 * GraphicsTools::Colors::White, 4};
-    objMap->emplace(env->lastObjId(), GraphicsTools::RenderObject());
-    objMap->at(env->lastObjId()).setShader(shader);
-    objMap->at(env->lastObjId()).setMaterial(mat);
-    objMap->at(env->lastObjId())
-        .genSphere((*ctrls)["radius"] * simParams.environment_unitsPerMeter, 16,
-                   16);
-    objMap->at(env->lastObjId())
-        .setPos(glm::vec3(candidateObjPos.x(), candidateObjPos.y(),
-                          candidateObjPos.z()));
-    win.activeScene()->addRenderObject(&objMap->at(env->lastObjId()));
+                                     (*ctrls)["angularAxisZ"]));
+    // the ball joins the environment on its next step; its render object
+    // exists right away and stays where it was created until then
+    int objId = env->reserveObjId();
+    env->post([objId, obj](Environment &e) { e.addObj(objId, obj); });
+    addBallRenderObj(win, objId,
+                     (*ctrls)["radius"] * simParams.environment_unitsPerMeter,
+                     candidateObjPos);
   }
 }
 
+void addBallRenderObj(GraphicsTools::Window &win, int objId, double radius,
+                      Vec3 pos) {
+  simUtils::ObjMap *objMap =
+      static_cast<simUtils::ObjMap *>(win.userPointer("ballObjMap"));
+  GraphicsTools::ShaderProgram *shader =
+      static_cast<GraphicsTools::ShaderProgram *>(
+          win.userPointer("ballShader"));
+  GraphicsTools::Material mat = {GraphicsTools::randomColor(), NULL,
+                                 0.5 * GraphicsTools::Colors::White, 4};
+  objMap->emplace(objId, GraphicsTools::RenderObject());
+  objMap->at(objId).setShader(shader);
+  objMap->at(objId).setMaterial(mat);
+  objMap->at(objId).genSphere(radius, 16, 16);
+  objMap->at(objId).setPos(glm::vec3(pos.x(), pos.y(), pos.z()));
+  win.activeScene()->addRenderObject(&objMap->at(objId));
+}
+
 void drawUserCursor(GraphicsTools::Window &win, simUtils::UserCursor *uc,
                     bool insideEnv, int objIdAtCursor) {
   simUtils::ObjMap *staticObjs =
@@ -222,7 +234,8 @@ void populateSpinRingPoints(float spinSpeed, float ringRadius, Vec3 ringOrigin,
   }
 }
 
-void drawSim(GraphicsTools::Window &win) {
+void drawSim(GraphicsTools::Window &win, double alpha) {
+  PROFILE_SCOPE(Phase::DrawSim);
   simUtils::ObjMap *staticObjs =
       (simUtils::ObjMap *)(win.userPointer("staticObjMap"));
 
@@ -236,38 +249,46 @@ void drawSim(GraphicsTools::Window &win) {
   GraphicsTools::Font *font =
       static_cast<GraphicsTools::Font *>(win.userPointer("font"));
 
+  const EnvSnapshot &objs = envSnapshot(win);
+
   bool insideEnv =
       env->computeOutsideEnv(
              Vec3(uc->data.ballX, uc->data.ballY, uc->data.ballZ), 0.0)
           .mag() == 0;
 
   int objIdAtCursor =
-      objIdAtEnvPos(Vec3(uc->data.ballX, uc->data.ballY, uc->data.ballZ), *env);
+      objIdAtEnvPos(Vec3(uc->data.ballX, uc->data.ballY, uc->data.ballZ), objs);
 
   simUtils::drawUserCursor(
       win, uc,
       insideEnv &&
           (uc->activeTool == Tool::PushTool ||
            objIdAtEnvPos(Vec3(uc->data.ballX, uc->data.ballY, uc->data.ballZ),
-                         *env,
+                         objs,
                          (*ctrls)["radius"] * 2.0 *
                              simParams.environment_unitsPerMeter) == -1),
       objIdAtCursor);
   simUtils::drawCursor(win, cursorEmu->current,
                        *(int *)(win.userPointer("cursorEmuObjId")));
 
-  for (auto &obj : env->objs()) {
-    Vec3 drawPos = obj.second.bbox().pos();
+  for (int i = 0; i < objs.size(); ++i) {
+    // removed balls can outlive their render object by a step
+    auto drawObjIt = envObjs->find(objs.ids[i]);
+    if (drawObjIt == envObjs->end()) {
+      continue;
+    }
+    Vec3 prevPos = objs.prevPos.get(i);
+    Vec3 drawPos = prevPos + (Vec3(objs.pos.get(i)) - prevPos) * alpha;
     Vec3 drawAxis;
     double drawAngle;
-    obj.second.rot().toAxisAngle(drawAxis, drawAngle);
-    envObjs->at(obj.first).setPos(
-        glm::vec3(drawPos.x(), drawPos.y(), drawPos.z()));
-    // envObjs->at(obj.first).setRotation(
-    //     glm::quat(obj.second.rot().w(), obj.second.rot().x(),
-    //               obj.second.rot().y(), obj.second.rot().z()));
-    envObjs->at(obj.first).setRotation(
-        glm::vec3(drawAxis.x(), drawAxis.y(), drawAxis.z()), drawAngle);
+    slerp(Quaternion(objs.prevRot[i]), Quaternion(objs.rot[i]), alpha)
+        .toAxisAngle(drawAxis, drawAngle);
+    GraphicsTools::RenderObject &drawObj = drawObjIt->second;
+    drawObj.setPos(glm::vec3(drawPos.x(), drawPos.y(), drawPos.z()));
+    // drawObj.setRotation(glm::quat(objs.rot[i].w(), objs.rot[i].x(),
+    //                               objs.rot[i].y(), objs.rot[i].z()));
+    drawObj.setRotation(glm::vec3(drawAxis.x(), drawAxis.y(), drawAxis.z()),
+                        drawAngle);
   }
 
   win.clear();
@@ -298,7 +319,7 @@ void removeEnvObj(GraphicsTools::Window &win, int objId) {
     return;
   Environment *env = static_cast<Environment *>(win.userPointer("env"));
   ObjMap *objMap = static_cast<ObjMap *>(win.userPointer("ballObjMap"));
-  env->removeObj(objId);
+  env->post([objId](Environment &e) { e.removeObj(objId); });
   objMap->erase(objId);
   win.activeScene()->removeRenderObject(objId);
 }
@@ -306,8 +327,11 @@ void removeEnvObj(GraphicsTools::Window &win, int objId) {
 void clearEnvObjs(GraphicsTools::Window &win) {
   Environment *env = static_cast<Environment *>(win.userPointer("env"));
   ObjMap *objMap = static_cast<ObjMap *>(win.userPointer("ballObjMap"));
+  env->post([](Environment &e) { e.clearObjs(); });
+  if (objMap->empty()) {
+    return;
+  }
   auto firstObjKey = objMap->begin()->first;
-  env->clearObjs();
   objMap->clear();
   // assume all obj IDs >= 1000
   auto renderObjList = win.activeScene()->objs();
@@ -409,15 +433,17 @@ void setupControls(ControlSet &ctrlSet) {
 
 // whether ball at pos overlaps with any other ball
 // point test for zero radius
-int objIdAtEnvPos(Vec3 pos, Environment &env, float radius) {
-  for (auto &obj : env.objs()) {
+int objIdAtEnvPos(Vec3 pos, const EnvSnapshot &objs, float radius) {
+  for (int i = 0; i < objs.size(); ++i) {
+    BBox objBBox(objs.pos.get(i), 2.0 * objs.radius[i]);
+    objBBox.setProperties(BBoxProperties::IsSpherical);
     if (radius == 0.0) {
-      if (obj.second.bbox().containsPoint(pos)) {
-        return obj.first;
+      if (objBBox.containsPoint(pos)) {
+        return objs.ids[i];
       }
     } else {
-      if (obj.second.bbox().intersects(BBox(pos, radius))) {
-        return obj.first;
+      if (objBBox.intersects(BBox(pos, radius))) {
+        return objs.ids[i];
       }
     }
   }
@@ -555,11 +581,15 @@ void handleUserInput(GraphicsTools::Window &win) {
 
   //
   if (userCursor->selectedObjId != -1) {
-    env->objs()
-        .at(userCursor->selectedObjId)
-        .setPos(Vec3(userCursor->data.ballX, userCursor->data.ballY,
-                     userCursor->data.ballZ) +
-                userCursor->objSelectionOffset);
+    int objId = userCursor->selectedObjId;
+    Vec3 objPos = Vec3(userCursor->data.ballX, userCursor->data.ballY,
+                       userCursor->data.ballZ) +
+                  userCursor->objSelectionOffset;
+    env->post([objId, objPos](Environment &e) {
+      if (e.objs().contains(objId)) {
+        e.objs().at(objId).setPos(objPos);
+      }
+    });
   }
 
   // revisit? newX and newY are 2D
@@ -589,29 +619,27 @@ void handleUserInput(GraphicsTools::Window &win) {
       userCursor->selectedObjId == -1) {
     double maxDistance = 50.0;
     userCursor->forwardObjId = -1;
-    for (auto &obj : env->objs()) {
+    Vec3 forwardObjPos;
+    const EnvSnapshot &objs = envSnapshot(win);
+    for (int i = 0; i < objs.size(); ++i) {
+      Vec3 objPos = objs.pos.get(i);
       double dotProductTest =
           simUtils::glmToVec3(cam->localForward())
               .unit()
-              .dot((obj.second.bbox().pos() - simUtils::glmToVec3(cam->pos()))
-                       .unit());
+              .dot((objPos - simUtils::glmToVec3(cam->pos())).unit());
       double lineSphereTest =
           std::pow(simUtils::glmToVec3(cam->localForward())
                        .unit()
-                       .dot(simUtils::glmToVec3(cam->pos()) -
-                            obj.second.bbox().pos()),
+                       .dot(simUtils::glmToVec3(cam->pos()) - objPos),
                    2) -
-          std::pow(
-              Vec3((simUtils::glmToVec3(cam->pos())) - obj.second.bbox().pos())
-                  .mag(),
-              2) +
-          std::pow(obj.second.bbox().w() * 0.5, 2);
-      double dist =
-          (obj.second.bbox().pos() - simUtils::glmToVec3(cam->pos())).mag();
+          std::pow(Vec3((simUtils::glmToVec3(cam->pos())) - objPos).mag(), 2) +
+          std::pow(objs.radius[i], 2);
+      double dist = (objPos - simUtils::glmToVec3(cam->pos())).mag();
       if (lineSphereTest > -3 && dotProductTest > 0.99 && dist < maxDistance) {
         maxDistance = dist;
         userCursor->closestForwardDistance = dist;
-        userCursor->forwardObjId = obj.first;
+        userCursor->forwardObjId = objs.ids[i];
+        forwardObjPos = objPos;
       }
     }
 
@@ -620,7 +648,7 @@ void handleUserInput(GraphicsTools::Window &win) {
     }
 
     if ((userCursor->selectedObjId == -1 && userCursor->forwardObjId != -1)) {
-      baseCursorPos = env->objs().at(userCursor->forwardObjId).bbox().pos();
+      baseCursorPos = forwardObjPos;
     }
   }
   userCursor->data.ballX = baseCursorPos.x();
@@ -733,7 +761,15 @@ void keyCallback(GLFWwindow *win, int key, int scancode, int action, int mods) {
   }
   if (key == simParams.input_pause && action == GLFW_PRESS) {
     Environment *env = static_cast<Environment *>(mbWin->userPointer("env"));
-    env->togglePause();
+    env->post([](Environment &e) { e.togglePause(); });
+  }
+  if (key == simParams.input_profile && action == GLFW_PRESS) {
+    PROFILE_DUMP(std::cerr);
+  }
+  if (key == simParams.input_save && action == GLFW_PRESS) {
+    Environment *env = static_cast<Environment *>(mbWin->userPointer("env"));
+    std::string fileName = simParams.environment_snapshot;
+    env->post([fileName](Environment &e) { e.save(fileName); });
   }
 }
 
@@ -787,9 +823,9 @@ void mouseButtonCallback(GLFWwindow *win, int button, int action, int m) {
         simUtils::glmToVec3(cam->localForward()).dot(uc->objKickVel) < 0;
   }
   if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE) {
-    Environment *env = (Environment *)mbWin->userPointer("env");
     Vec3 candidateObjPos(uc->data.ballX, uc->data.ballY, uc->data.ballZ);
-    int objIdAtCandPos = simUtils::objIdAtEnvPos(candidateObjPos, *env);
+    int objIdAtCandPos =
+        simUtils::objIdAtEnvPos(candidateObjPos, envSnapshot(*mbWin));
     if (objIdAtCandPos != -1 && uc->activeTool != simUtils::Tool::PushTool) {
       simUtils::removeEnvObj(*mbWin, objIdAtCandPos);
     }
@@ -798,13 +834,18 @@ void mouseButtonCallback(GLFWwindow *win, int button, int action, int m) {
     Environment *env = (Environment *)mbWin->userPointer("env");
     Vec3 candidateObjPos(uc->data.ballX, uc->data.ballY, uc->data.ballZ);
 
-    int objIdAtCandPos = simUtils::objIdAtEnvPos(candidateObjPos, *env);
+    const EnvSnapshot &objs = envSnapshot(*mbWin);
+    int objIdAtCandPos = simUtils::objIdAtEnvPos(candidateObjPos, objs);
     if (objIdAtCandPos != -1) {
       if (uc->activeTool != simUtils::Tool::PushTool) {
-        env->objs().at(objIdAtCandPos).setSelectState(true);
+        env->post([objIdAtCandPos](Environment &e) {
+          if (e.objs().contains(objIdAtCandPos)) {
+            e.objs().at(objIdAtCandPos).setSelectState(true);
+          }
+        });
         uc->selectedObjId = objIdAtCandPos;
         uc->objSelectionOffset =
-            env->objs().at(objIdAtCandPos).bbox().pos() - candidateObjPos;
+            Vec3(objs.pos.get(objs.find(objIdAtCandPos))) - candidateObjPos;
       }
     }
   }
@@ -817,9 +858,15 @@ void mouseButtonCallback(GLFWwindow *win, int button, int action, int m) {
     Vec3 candidateObjPos(uc->data.ballX, uc->data.ballY, uc->data.ballZ);
 
     if (uc->activeTool == simUtils::Tool::PushTool) {
-      int objIdAtCandPos = simUtils::objIdAtEnvPos(candidateObjPos, *env);
+      int objIdAtCandPos =
+          simUtils::objIdAtEnvPos(candidateObjPos, envSnapshot(*mbWin));
       if (objIdAtCandPos != -1) {
-        env->objs().at(objIdAtCandPos).applyForce(10000 * uc->objKickVel);
+        Vec3 kick = 10000 * uc->objKickVel;
+        env->post([objIdAtCandPos, kick](Environment &e) {
+          if (e.objs().contains(objIdAtCandPos)) {
+            e.objs().at(objIdAtCandPos).applyForce(kick);
+          }
+        });
       }
     } else {
       // no object at cursor and no object selected: create a new object
@@ -828,13 +875,6 @@ void mouseButtonCallback(GLFWwindow *win, int button, int action, int m) {
       }
     }
     if (uc->selectedObjId != -1) {
-      Ball &selected = env->objs().at(uc->selectedObjId);
-      // push obj back inside if outside
-      selected.setPos(selected.bbox().pos() -
-                      env->computeOutsideEnv(selected.bbox().pos(),
-                                             selected.bbox().w() * 0.5));
-      // obj selected: unselect it
-      env->objs().at(uc->selectedObjId).setSelectState(false);
       // glm::vec4 rotatedVector =
       //     cam->viewMatrix() *
       //     glm::vec4({uc->cursorVel.x(), uc->cursorVel.y(), 0, 0});
@@ -848,9 +888,21 @@ void mouseButtonCallback(GLFWwindow *win, int button, int action, int m) {
       std::cerr << uc->cursorVel << " \n";
       std::cerr << rotatedVector.x << " " << rotatedVector.y << "  "
                 << rotatedVector.z << "\n";
-      env->objs()
-          .at(uc->selectedObjId)
-          .setVel(Vec3(rotatedVector.x, rotatedVector.y, rotatedVector.z));
+      int objId = uc->selectedObjId;
+      Vec3 releaseVel(rotatedVector.x, rotatedVector.y, rotatedVector.z);
+      env->post([objId, releaseVel](Environment &e) {
+        if (!e.objs().contains(objId)) {
+          return;
+        }
+        BallRef selected = e.objs().at(objId);
+        // push obj back inside if outside
+        selected.setPos(selected.bbox().pos() -
+                        e.computeOutsideEnv(selected.bbox().pos(),
+                                            selected.bbox().w() * 0.5));
+        // obj selected: unselect it
+        selected.setSelectState(false);
+        selected.setVel(releaseVel);
+      });
       uc->selectedObjId = -1;
     }
   }
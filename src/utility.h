@@ -49,7 +49,9 @@ void drawCursor(GraphicsTools::Window &win, CursorData cur, int curGfxId);
 void populateSpinRingPoints(float speed, float radius, Vec3 origin, Vec3 axis,
                             float *destArray, int arraySize);
 
-void drawSim(GraphicsTools::Window &win);
+// alpha: how far the environment is between its previous step (0) and its
+// current step (1)
+void drawSim(GraphicsTools::Window &win, double alpha = 1.0);
 void setupUserCursors(GraphicsTools::Window &win, UserCursor *uc);
 
 double computeTNow();
@@ -62,12 +64,17 @@ double scalarRk4(const double &v, const double &dv, const double &ddv,
 // common object creation
 void createObj(GraphicsTools::Window &win, Vec3 candidateObjPos,
                Vec3 candidateObjVel);
+// render object for a ball already in (or posted to) the environment
+void addBallRenderObj(GraphicsTools::Window &win, int objId, double radius,
+                      Vec3 pos);
 // linked object deletion
 void clearEnvObjs(GraphicsTools::Window &win);
 void removeEnvObj(GraphicsTools::Window &win, int objId);
 void setupControls(ControlSet &ctrlSet);
 
-int objIdAtEnvPos(Vec3 pos, Environment &env, float radius = 0.0);
+// UI threads read ball state from the latest published snapshot
+const EnvSnapshot &envSnapshot(GraphicsTools::WindowBase &win);
+int objIdAtEnvPos(Vec3 pos, const EnvSnapshot &objs, float radius = 0.0);
 
 Vec3 glmToVec3(glm::vec3 v);
 
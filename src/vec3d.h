@@ -1,66 +1,188 @@
-/* A vector in three-dimensional space. */
+/* A vector in three-dimensional space. Header-only and trivially copyable,
+    so the math inlines into its callers and arrays of vectors can be copied
+    as raw memory. Vec3 is the double-precision vector used for geometry,
+    input and rendering; Vec3R uses the precision of the simulation state
+    (Real, see below). */
 
 #ifndef VEC3D_H
 #define VEC3D_H
 
+#include <cmath>
 #include <iostream>
+#include <type_traits>
+#include <vector>
 
-class Vec3 {
+// below this magnitude a vector counts as zero (unit() returns zero)
+inline constexpr double EQ_TOLERANCE = 1e-10;
+
+template <typename T> class Vec3T {
 private:
-  double _x;
-  double _y;
-  double _z;
+  T _x;
+  T _y;
+  T _z;
 
 public:
-  // ctor, dtor
-  Vec3(); // zero vector
-  Vec3(double x, double y); // zero z-component
-  Vec3(double x, double y, double z);
-  Vec3(const Vec3 &dir, double mag);
-  Vec3(const Vec3 &v);
-  Vec3 &operator=(const Vec3 &v);
-  ~Vec3();
+  typedef T Scalar;
+
+  // ctor
+  constexpr Vec3T() : _x(0), _y(0), _z(0) {} // zero vector
+  constexpr Vec3T(T x, T y) : _x(x), _y(y), _z(0) {} // zero z-component
+  constexpr Vec3T(T x, T y, T z) : _x(x), _y(y), _z(z) {}
+  Vec3T(const Vec3T &dir, T mag) {
+    T lat, lon;
+    lat = std::atan2(dir.unit()._y, std::hypot(dir.unit()._x, dir.unit()._z));
+    lon = std::atan2(dir.unit()._z, dir.unit()._x);
+    _x = mag * std::cos(lat) * std::sin(lon);
+    _y = mag * std::sin(lat);
+    _z = mag * std::cos(lat) * std::cos(lon);
+  }
+  // precision conversion; implicit only when widening
+  template <typename U>
+  constexpr explicit(sizeof(U) > sizeof(T)) Vec3T(const Vec3T<U> &v)
+      : _x(v.x()), _y(v.y()), _z(v.z()) {}
 
   // getters
-  double x() const { return _x; };
-  double y() const { return _y; };
-  double z() const { return _z; };
-  double mag() const;
+  constexpr T x() const { return _x; };
+  constexpr T y() const { return _y; };
+  constexpr T z() const { return _z; };
+  T mag() const { return std::sqrt(_x * _x + _y * _y + _z * _z); };
   // double dir() const;
   // "direction" is not as important in 3D; lat/lon would be closest, but is of
   // less use
-  Vec3 unit() const; // unit vector in same direction
+  Vec3T unit() const { // unit vector in same direction
+    T m = mag();
+    return m < T(EQ_TOLERANCE) ? Vec3T() : Vec3T(_x / m, _y / m, _z / m);
+  };
 
   // math operations
-  Vec3 plus(const Vec3 &v) const;
-  Vec3 operator+(const Vec3 &v) const;
-  Vec3 &operator+=(const Vec3 &v);
-  Vec3 minus(const Vec3 &v) const;
-  Vec3 operator-(const Vec3 &v) const;
-  Vec3 scalarMultiple(double k) const;
-  Vec3 operator*(double k) const;
-  Vec3 operator/(double k) const;
-  Vec3 operator-() const;
-  double dot(const Vec3 &v) const;
-  Vec3 cross(const Vec3 &v) const;
-  bool equals(const Vec3 &v) const;
-  bool operator==(const Vec3 &v) const;
+  constexpr Vec3T plus(const Vec3T &v) const {
+    return Vec3T(_x + v._x, _y + v._y, _z + v._z);
+  };
+  constexpr Vec3T operator+(const Vec3T &v) const { return plus(v); };
+  constexpr Vec3T &operator+=(const Vec3T &v) {
+    *this = plus(v);
+    return *this;
+  };
+  constexpr Vec3T minus(const Vec3T &v) const {
+    return Vec3T(_x - v._x, _y - v._y, _z - v._z);
+  };
+  constexpr Vec3T operator-(const Vec3T &v) const { return minus(v); };
+  constexpr Vec3T scalarMultiple(T k) const {
+    return Vec3T(_x * k, _y * k, _z * k);
+  };
+  constexpr Vec3T operator*(T k) const { return scalarMultiple(k); };
+  constexpr Vec3T operator/(T k) const { return scalarMultiple(1 / k); };
+  constexpr Vec3T operator-() const { return scalarMultiple(-1); };
+  // commutative scalar multiplication
+  friend constexpr Vec3T operator*(T k, const Vec3T &v) { return v * k; };
+  constexpr T dot(const Vec3T &v) const {
+    return _x * v._x + _y * v._y + _z * v._z;
+  };
+  constexpr Vec3T cross(const Vec3T &v) const {
+    return Vec3T((_y * v._z - _z * v._y), (_z * v._x - _x * v._z),
+                 (_x * v._y - _y * v._x));
+  };
+  constexpr bool equals(const Vec3T &v) const {
+    return (_x - v._x < T(EQ_TOLERANCE) && v._x - _x < T(EQ_TOLERANCE)) &&
+           (_y - v._y < T(EQ_TOLERANCE) && v._y - _y < T(EQ_TOLERANCE)) &&
+           (_z - v._z < T(EQ_TOLERANCE) && v._z - _z < T(EQ_TOLERANCE));
+  };
+  constexpr bool operator==(const Vec3T &v) const { return (equals(v)); };
 
   // numerical methods
-  friend Vec3 euler(const Vec3 &v, const Vec3 &dv, double dt);
-  friend Vec3 rk4(const Vec3 &v, const Vec3 &dv, const Vec3 &ddv, double dt);
-  friend Vec3 rk4_38(const Vec3 &v, const Vec3 &dv, const Vec3 &ddv,
-                     double dt); // lower-error 3/8 rule?
+  friend constexpr Vec3T euler(const Vec3T &v, const Vec3T &dv, T dt) {
+    return v + (dv * dt);
+  };
+  friend constexpr Vec3T rk4(const Vec3T &v, const Vec3T &dv,
+                             const Vec3T &ddv, T dt) {
+    Vec3T k1 = dv;
+    Vec3T k2 = euler(k1, dv + (T(0.5) * dt * ddv), T(0.5) * dt);
+    Vec3T k3 = euler(k2, dv + (T(0.5) * dt * ddv), T(0.5) * dt);
+    Vec3T k4 = euler(k3, dv + (dt * ddv), dt);
+
+    return v + (dt * ((k1 + T(2) * k2 + T(2) * k3 + k4) / T(6)));
+  };
+  // lower-error 3/8 rule?
+  friend constexpr Vec3T rk4_38(const Vec3T &v, const Vec3T &dv,
+                                const Vec3T &ddv, T dt) {
+    Vec3T k1 = dv;
+    Vec3T k2 =
+        T(0.333) * euler(k1, dv + (T(0.333) * dt * ddv), T(0.333) * dt);
+    Vec3T k3 =
+        T(-0.333) * euler(k1, dv + (T(0.667) * dt * ddv), T(0.667) * dt) +
+        euler(k2, dv + (T(0.667) * dt * ddv), T(0.667) * dt);
+    Vec3T k4 = euler(k1, dv + (dt * ddv), dt) -
+               euler(k2, dv + (dt * ddv), dt) +
+               euler(k3, dv + (dt * ddv), dt);
+
+    return v + (dt * ((k1 + T(3) * k2 + T(3) * k3 + k4) / T(8)));
+  };
 
   // debug
-  void print(std::ostream &out) const;
+  void print(std::ostream &out) const {
+    out << "(" << x() << "," << y() << "," << z() << ")";
+  };
 };
 
-Vec3 operator*(double k, const Vec3 &v); // commutative scalar multiplication
+typedef Vec3T<double> Vec3;
+static_assert(std::is_trivially_copyable_v<Vec3>);
 
-inline std::ostream &operator<<(std::ostream &out, const Vec3 vec) {
+template <typename T>
+inline std::ostream &operator<<(std::ostream &out, const Vec3T<T> &vec) {
   vec.print(out);
   return out;
 }
 
+// precision of the simulation state: ball storage, force kernels and
+// integration. build with -DSINGLE_PRECISION (make PRECISION=single) for
+// float, which halves the memory traffic per ball and doubles the SIMD
+// width; time and energy sums stay double either way
+#ifdef SINGLE_PRECISION
+typedef float Real;
+#else
+typedef double Real;
+#endif
+typedef Vec3T<Real> Vec3R;
+
+// a list of vectors stored as one array per component, so loops over many
+// vectors read contiguous memory. setters take either precision
+struct Vec3Array {
+  std::vector<Real> x, y, z;
+
+  int size() const { return x.size(); };
+  Vec3R get(int i) const { return Vec3R(x[i], y[i], z[i]); };
+  template <typename U> void set(int i, const Vec3T<U> &v) {
+    x[i] = v.x();
+    y[i] = v.y();
+    z[i] = v.z();
+  };
+  template <typename U> void add(int i, const Vec3T<U> &v) {
+    x[i] += v.x();
+    y[i] += v.y();
+    z[i] += v.z();
+  };
+  template <typename U> void push_back(const Vec3T<U> &v) {
+    x.push_back(v.x());
+    y.push_back(v.y());
+    z.push_back(v.z());
+  };
+  void resize(int n) {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+  };
+  void clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+  };
+  // overwrite element i with the last element and drop the last
+  void eraseBySwap(int i) {
+    set(i, get(size() - 1));
+    x.pop_back();
+    y.pop_back();
+    z.pop_back();
+  };
+};
+
 #endif